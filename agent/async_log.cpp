@@ -0,0 +1,166 @@
+#include "async_log.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+AsyncLog::AsyncLog() : enqueue_pos(0), dequeue_pos(0), dropped_records(0),
+                       reported_drops(0), running(true) {
+    for (size_t i = 0; i < RING_CAPACITY; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    drain_thread = std::thread(&AsyncLog::drain_function, this);
+}
+
+AsyncLog::~AsyncLog() {
+    running = false;
+    if (drain_thread.joinable()) {
+        drain_thread.join(); // final pass flushes whatever is queued
+    }
+}
+
+AsyncLog& AsyncLog::instance() {
+    static AsyncLog log;
+    return log;
+}
+
+void AsyncLog::write(LogLevel level, const char* format, va_list args) {
+    // Claim a cell. A cell whose sequence lags its position is still
+    // unconsumed — the ring is full, so drop rather than wait.
+    uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Record* cell;
+    for (;;) {
+        cell = &ring[pos & RING_MASK];
+        uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            dropped_records.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    cell->timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    cell->level = level;
+
+    int length = vsnprintf(cell->message, sizeof(cell->message), format, args);
+    if (length < 0) {
+        length = 0;
+    } else if ((size_t)length >= sizeof(cell->message)) {
+        length = sizeof(cell->message) - 1;
+    }
+    cell->length = (uint16_t)length;
+
+    // Publish: the drain thread may read the cell from here on
+    cell->sequence.store(pos + 1, std::memory_order_release);
+}
+
+size_t AsyncLog::format_record(const Record& record, char* out, size_t capacity) {
+    static const char* level_names[3] = {"INFO ", "WARN ", "ERROR"};
+
+    time_t seconds = (time_t)(record.timestamp_ns / 1000000000ull);
+    unsigned millis = (unsigned)((record.timestamp_ns / 1000000ull) % 1000);
+    struct tm tm_buf;
+    localtime_r(&seconds, &tm_buf);
+
+    int written = snprintf(out, capacity,
+                           "%04d-%02d-%02d %02d:%02d:%02d.%03u %s %.*s\n",
+                           tm_buf.tm_year + 1900, tm_buf.tm_mon + 1,
+                           tm_buf.tm_mday, tm_buf.tm_hour, tm_buf.tm_min,
+                           tm_buf.tm_sec, millis,
+                           level_names[record.level < 3 ? record.level : 2],
+                           (int)record.length, record.message);
+    if (written < 0) {
+        return 0;
+    }
+    return (size_t)written < capacity ? (size_t)written : capacity - 1;
+}
+
+void AsyncLog::drain_function() {
+    // Consume ready cells into a batch buffer and emit it with one write
+    // per batch. Runs a final sweep after stop so shutdown messages land.
+    char batch[64 * 1024];
+    size_t batch_used = 0;
+
+    for (;;) {
+        bool drained_any = false;
+
+        for (;;) {
+            Record& cell = ring[dequeue_pos & RING_MASK];
+            uint64_t seq = cell.sequence.load(std::memory_order_acquire);
+            if ((intptr_t)seq - (intptr_t)(dequeue_pos + 1) != 0) {
+                break; // next cell not published yet
+            }
+
+            if (batch_used + 512 > sizeof(batch)) {
+                ssize_t rc = ::write(STDERR_FILENO, batch, batch_used);
+                (void)rc;
+                batch_used = 0;
+            }
+            batch_used += format_record(cell, batch + batch_used,
+                                        sizeof(batch) - batch_used);
+
+            // Hand the cell back to producers one lap ahead
+            cell.sequence.store(dequeue_pos + RING_CAPACITY,
+                                std::memory_order_release);
+            dequeue_pos++;
+            drained_any = true;
+        }
+
+        // Surface drops as their own log line, throttled to once per batch
+        uint64_t drops = dropped_records.load(std::memory_order_relaxed);
+        if (drops > reported_drops && batch_used + 128 <= sizeof(batch)) {
+            int written = snprintf(batch + batch_used, sizeof(batch) - batch_used,
+                                   "WARN  log ring overflow: %llu record(s) dropped\n",
+                                   (unsigned long long)(drops - reported_drops));
+            if (written > 0) {
+                batch_used += written;
+            }
+            reported_drops = drops;
+        }
+
+        if (batch_used > 0) {
+            ssize_t rc = ::write(STDERR_FILENO, batch, batch_used);
+            (void)rc;
+            batch_used = 0;
+        }
+
+        if (!drained_any) {
+            if (!running) {
+                return;
+            }
+            // Nothing pending; sleep briefly instead of spinning
+            struct timespec pause = {0, 2 * 1000 * 1000};
+            nanosleep(&pause, nullptr);
+        }
+    }
+}
+
+void log_info(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    AsyncLog::instance().write(LOG_LEVEL_INFO, format, args);
+    va_end(args);
+}
+
+void log_warn(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    AsyncLog::instance().write(LOG_LEVEL_WARN, format, args);
+    va_end(args);
+}
+
+void log_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    AsyncLog::instance().write(LOG_LEVEL_ERROR, format, args);
+    va_end(args);
+}
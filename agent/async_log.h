@@ -0,0 +1,71 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstdarg>
+
+// Asynchronous logger. Producers format into a fixed-size record and
+// publish it to a bounded lock-free MPMC ring (Vyukov-style per-cell
+// sequence numbers); a dedicated drain thread batches records, stamps
+// them with wall-clock time and level, and writes them to stderr. A hot
+// path therefore pays one vsnprintf and a handful of atomic operations —
+// it can never block on a TTY, a pipe, or journald backpressure. When
+// the ring is full the record is dropped and counted instead of stalling
+// the producer; the drain thread reports accumulated drops inline.
+//
+// Use via the log_info/log_warn/log_error free functions (printf-style).
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_INFO = 0,
+    LOG_LEVEL_WARN = 1,
+    LOG_LEVEL_ERROR = 2,
+};
+
+class AsyncLog {
+private:
+    // One ring cell: 256 bytes, cache-line aligned whole. The sequence
+    // field is the Vyukov handshake — it equals the cell's position when
+    // free to write, position+1 when ready to read.
+    struct Record {
+        std::atomic<uint64_t> sequence;
+        uint64_t timestamp_ns;  // CLOCK_REALTIME at enqueue
+        uint8_t level;
+        uint16_t length;
+        char message[229];
+    };
+
+    static constexpr size_t RING_CAPACITY = 4096; // power of two, ~1MB
+    static constexpr size_t RING_MASK = RING_CAPACITY - 1;
+
+    Record ring[RING_CAPACITY];
+    std::atomic<uint64_t> enqueue_pos;
+    uint64_t dequeue_pos; // drain thread only
+    std::atomic<uint64_t> dropped_records;
+    uint64_t reported_drops; // drain thread only
+
+    std::thread drain_thread;
+    std::atomic<bool> running;
+
+    void drain_function();
+    size_t format_record(const Record& record, char* out, size_t capacity);
+
+public:
+    AsyncLog();
+    ~AsyncLog();
+
+    static AsyncLog& instance();
+
+    void write(LogLevel level, const char* format, va_list args);
+
+    uint64_t dropped() const {
+        return dropped_records.load(std::memory_order_relaxed);
+    }
+};
+
+void log_info(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void log_warn(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void log_error(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // ASYNC_LOG_H
@@ -0,0 +1,325 @@
+#include "binary_server.h"
+#include "async_log.h"
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+BinaryServer::BinaryServer(NodeAgent& agent, int port) : agent(agent), port(port), running(false) {
+    server_socket = -1;
+    adopted_listener = -1;
+}
+
+BinaryServer::~BinaryServer() {
+    stop_server();
+}
+
+bool BinaryServer::start_server() {
+    // A listener handed off by a draining predecessor is already bound
+    // and listening; adopting it keeps its accept queue intact
+    if (adopted_listener >= 0) {
+        server_socket = adopted_listener;
+        adopted_listener = -1;
+        int flags = fcntl(server_socket, F_GETFL, 0);
+        if (flags >= 0) {
+            fcntl(server_socket, F_SETFL, flags | O_NONBLOCK);
+        }
+        running = true;
+        log_info("Binary protocol server adopted listener on port %d from predecessor",
+                 port);
+        return true;
+    }
+
+    server_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_socket < 0) {
+        log_error("Error creating binary server socket");
+        return false;
+    }
+
+    int opt = 1;
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        log_error("Error setting binary server socket options");
+        return false;
+    }
+
+    struct sockaddr_in server_addr;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        log_error("Error binding binary server socket");
+        return false;
+    }
+
+    if (listen(server_socket, 32) < 0) {
+        log_error("Error listening on binary server socket");
+        return false;
+    }
+
+    // Non-blocking: during a handoff the predecessor and successor both
+    // poll this socket, and the loser of an accept race must not block
+    int flags = fcntl(server_socket, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(server_socket, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    running = true;
+    log_info("Binary protocol server started on port %d", port);
+    return true;
+}
+
+void BinaryServer::stop_server() {
+    running = false;
+    if (server_socket >= 0) {
+        // No shutdown() here: after a drain handoff the successor holds a
+        // duplicate of this descriptor, and shutdown acts on the shared
+        // socket — it would kill the transferred listener too. The accept
+        // loop polls with a timeout, so clearing `running` is enough.
+        close(server_socket);
+        server_socket = -1;
+    }
+
+    // Workers serving persistent scheduler connections sit in recv()
+    // between frames; nothing else wakes them, so shut their sockets
+    // down to make the pending recv return before joining. The
+    // descriptor itself stays open — its worker still closes it.
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        for (int client_socket : active_clients) {
+            shutdown(client_socket, SHUT_RDWR);
+        }
+    }
+
+    queue_cv.notify_all();
+    for (auto& thread : worker_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    worker_threads.clear();
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    for (int client_socket : client_queue) {
+        close(client_socket);
+    }
+    client_queue.clear();
+}
+
+void BinaryServer::run_server() {
+    for (int i = 0; i < WORKER_THREADS; ++i) {
+        worker_threads.emplace_back(&BinaryServer::worker_function, this);
+    }
+
+    // Poll with a timeout rather than blocking in accept, so stop_server
+    // only has to clear `running` — no need to disturb the socket itself,
+    // which a handoff successor may share
+    while (running) {
+        struct pollfd pfd;
+        pfd.fd = server_socket;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
+        if (client_socket < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ||
+                errno == ECONNABORTED) {
+                continue;
+            }
+            if (running) {
+                log_error("Error accepting binary connection");
+                // Persistent failure (EMFILE etc.): don't spin the loop
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            client_queue.push_back(client_socket);
+        }
+        queue_cv.notify_one();
+    }
+}
+
+void BinaryServer::worker_function() {
+    while (running) {
+        int client_socket = -1;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return !client_queue.empty() || !running; });
+            if (!running) {
+                break;
+            }
+            client_socket = client_queue.front();
+            client_queue.pop_front();
+            active_clients.insert(client_socket);
+        }
+
+        handle_connection(client_socket);
+
+        // Unregister before close so the descriptor number can't be
+        // reused by a new connection while still in the active set
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            active_clients.erase(client_socket);
+        }
+        close(client_socket);
+    }
+}
+
+void BinaryServer::handle_connection(int client_socket) {
+    // Scheduler connections are persistent: frames until the peer closes
+    std::vector<char> scratch;
+    std::vector<char> response;
+    scratch.reserve(4096);
+    response.reserve(4096);
+
+    while (running) {
+        uint32_t payload_length = 0;
+        uint8_t opcode = 0;
+
+        if (!read_exact(client_socket, &payload_length, sizeof(payload_length)) ||
+            !read_exact(client_socket, &opcode, sizeof(opcode))) {
+            break;
+        }
+
+        // Guard against a garbage length taking the agent down
+        if (payload_length > 1024 * 1024) {
+            break;
+        }
+
+        scratch.resize(payload_length);
+        if (payload_length > 0 && !read_exact(client_socket, scratch.data(), payload_length)) {
+            break;
+        }
+
+        bool ok = false;
+        switch (opcode) {
+            case OP_STATUS_REQUEST:
+                ok = handle_status(client_socket, response);
+                break;
+            case OP_START_REQUEST:
+                ok = handle_start(client_socket, scratch.data(), payload_length);
+                break;
+            case OP_STOP_REQUEST:
+                ok = handle_stop(client_socket, scratch.data(), payload_length);
+                break;
+            default:
+                ok = false;
+                break;
+        }
+
+        if (!ok) {
+            break;
+        }
+    }
+    // The worker that dispatched this connection closes the descriptor
+    // after removing it from the active set
+}
+
+bool BinaryServer::read_exact(int fd, void* buffer, size_t length) {
+    char* cursor = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t bytes_read = recv(fd, cursor, length, 0);
+        if (bytes_read <= 0) {
+            return false;
+        }
+        cursor += bytes_read;
+        length -= bytes_read;
+    }
+    return true;
+}
+
+bool BinaryServer::write_exact(int fd, const void* buffer, size_t length) {
+    const char* cursor = static_cast<const char*>(buffer);
+    while (length > 0) {
+        ssize_t bytes_sent = send(fd, cursor, length, MSG_NOSIGNAL);
+        if (bytes_sent <= 0) {
+            return false;
+        }
+        cursor += bytes_sent;
+        length -= bytes_sent;
+    }
+    return true;
+}
+
+bool BinaryServer::send_frame(int fd, uint8_t opcode, const void* payload, uint32_t length) {
+    return write_exact(fd, &length, sizeof(length)) &&
+           write_exact(fd, &opcode, sizeof(opcode)) &&
+           (length == 0 || write_exact(fd, payload, length));
+}
+
+bool BinaryServer::handle_status(int fd, std::vector<char>& scratch) {
+    SystemMetrics metrics = agent.get_system_metrics();
+    std::vector<ProcessInfo> processes = agent.get_running_processes();
+
+    WireMetrics wire_metrics;
+    wire_metrics.cpu_usage = metrics.cpu_usage;
+    wire_metrics.memory_usage = metrics.memory_usage;
+    wire_metrics.total_memory = metrics.total_memory;
+    wire_metrics.available_memory = metrics.available_memory;
+    wire_metrics.process_count = processes.size();
+
+    scratch.resize(sizeof(WireMetrics) + processes.size() * sizeof(WireProcessRecord));
+    char* cursor = scratch.data();
+    memcpy(cursor, &wire_metrics, sizeof(wire_metrics));
+    cursor += sizeof(wire_metrics);
+
+    for (const auto& proc : processes) {
+        WireProcessRecord record;
+        memset(&record, 0, sizeof(record));
+        record.pid = proc.pid;
+        record.cpu_percent = proc.cpu_percent;
+        record.rss_kb = proc.rss_kb;
+        record.exit_code = proc.exit_code;
+        record.running = (proc.exit_timestamp == 0) ? 1 : 0;
+        strncpy(record.command, proc.command.c_str(), sizeof(record.command) - 1);
+
+        memcpy(cursor, &record, sizeof(record));
+        cursor += sizeof(record);
+    }
+
+    return send_frame(fd, OP_STATUS_RESPONSE, scratch.data(), scratch.size());
+}
+
+bool BinaryServer::handle_start(int fd, const char* payload, uint32_t length) {
+    // Payload: NUL-separated strings, script path first then its args
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (payload[i] == '\0') {
+            parts.emplace_back(payload + start, i - start);
+            start = i + 1;
+        }
+    }
+    if (start < length) {
+        parts.emplace_back(payload + start, length - start);
+    }
+
+    int32_t pid = -1;
+    if (!parts.empty() && !parts[0].empty()) {
+        LaunchRequest request;
+        request.script_path = parts[0];
+        request.args.assign(parts.begin() + 1, parts.end());
+        pid = agent.start_process_batch({request})[0].pid;
+    }
+
+    return send_frame(fd, OP_START_RESPONSE, &pid, sizeof(pid));
+}
+
+bool BinaryServer::handle_stop(int fd, const char* payload, uint32_t length) {
+    uint8_t success = 0;
+    if (length >= sizeof(int32_t)) {
+        int32_t pid;
+        memcpy(&pid, payload, sizeof(pid));
+        success = agent.stop_process(pid) ? 1 : 0;
+    }
+
+    return send_frame(fd, OP_STOP_RESPONSE, &success, sizeof(success));
+}
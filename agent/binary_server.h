@@ -0,0 +1,88 @@
+#ifndef BINARY_SERVER_H
+#define BINARY_SERVER_H
+
+#include "node_agent.h"
+#include <cstdint>
+#include <set>
+#include <vector>
+#include <thread>
+
+// Compact binary protocol for scheduler<->agent traffic, served on its own
+// port next to the HTTP listener. Every frame is a little-endian
+// [uint32 payload_length][uint8 opcode][payload]; status payloads are the
+// fixed-layout wire structs below, so a poll is a memcpy out of the
+// metrics snapshot on our side and a memcpy into the scheduler's structs
+// on theirs — no text parsing or formatting on either end.
+
+enum BinaryOpcode : uint8_t {
+    OP_STATUS_REQUEST = 1,
+    OP_STATUS_RESPONSE = 2,
+    OP_START_REQUEST = 3,
+    OP_START_RESPONSE = 4,
+    OP_STOP_REQUEST = 5,
+    OP_STOP_RESPONSE = 6,
+    OP_HELLO = 7, // control channel only: agent identifies itself on connect
+};
+
+#pragma pack(push, 1)
+struct WireMetrics {
+    double cpu_usage;
+    double memory_usage;
+    int64_t total_memory;
+    int64_t available_memory;
+    uint32_t process_count; // number of WireProcessRecord entries following
+};
+
+struct WireProcessRecord {
+    int32_t pid;
+    double cpu_percent;
+    int64_t rss_kb;
+    int32_t exit_code;
+    uint8_t running; // 1 = still running, 0 = finished
+    char command[64]; // NUL-terminated, truncated if longer
+};
+#pragma pack(pop)
+
+class BinaryServer {
+private:
+    NodeAgent& agent;
+    int server_socket;
+    int adopted_listener;
+    int port;
+    std::atomic<bool> running;
+
+    static const int WORKER_THREADS = 4;
+    std::vector<std::thread> worker_threads;
+    std::deque<int> client_queue;
+    // Connections currently inside handle_connection, guarded by
+    // queue_mutex. stop_server shuts these down to wake workers parked
+    // in recv() between frames — a persistent connection's steady state
+    std::set<int> active_clients;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+
+    void worker_function();
+    void handle_connection(int client_socket);
+    bool read_exact(int fd, void* buffer, size_t length);
+    bool write_exact(int fd, const void* buffer, size_t length);
+    bool send_frame(int fd, uint8_t opcode, const void* payload, uint32_t length);
+
+    bool handle_status(int fd, std::vector<char>& scratch);
+    bool handle_start(int fd, const char* payload, uint32_t length);
+    bool handle_stop(int fd, const char* payload, uint32_t length);
+
+public:
+    BinaryServer(NodeAgent& agent, int port);
+    ~BinaryServer();
+
+    bool start_server();
+    void stop_server();
+    void run_server();
+
+    // Drain-and-handoff hooks (see handoff.h). adopt_listener must be
+    // called before start_server.
+    void adopt_listener(int fd) { adopted_listener = fd; }
+    int listener_fd() const { return server_socket; }
+};
+
+#endif // BINARY_SERVER_H
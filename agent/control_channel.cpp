@@ -0,0 +1,352 @@
+#include "control_channel.h"
+#include "async_log.h"
+#include <cstring>
+#include <cstdlib>
+#include <errno.h>
+#include <netinet/tcp.h>
+
+ControlChannel::ControlChannel(NodeAgent& agent, int agent_port)
+    : agent(agent), agent_port(agent_port), running(false) {
+    channel_socket = -1;
+    target_configured = false;
+    memset(&target, 0, sizeof(target));
+
+    const char* spec = getenv("NODE_AGENT_CONTROL_TARGET");
+    if (spec == nullptr || spec[0] == '\0') {
+        return;
+    }
+
+    std::string target_text(spec);
+    size_t colon = target_text.rfind(':');
+    if (colon == std::string::npos) {
+        log_error("Ignoring malformed control target: %s", target_text.c_str());
+        return;
+    }
+
+    target.sin_family = AF_INET;
+    target.sin_port = htons(atoi(target_text.c_str() + colon + 1));
+    if (inet_pton(AF_INET, target_text.substr(0, colon).c_str(), &target.sin_addr) != 1) {
+        log_error("Ignoring malformed control target: %s", target_text.c_str());
+        return;
+    }
+
+    target_configured = true;
+}
+
+ControlChannel::~ControlChannel() {
+    stop();
+}
+
+bool ControlChannel::start() {
+    if (!target_configured) {
+        return false;
+    }
+
+    running = true;
+    for (int i = 0; i < WORKER_THREADS; ++i) {
+        worker_threads.emplace_back(&ControlChannel::worker_function, this);
+    }
+    channel_thread = std::thread(&ControlChannel::channel_function, this);
+
+    char target_text[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &target.sin_addr, target_text, sizeof(target_text));
+    log_info("Control channel dialing %s:%d", target_text, ntohs(target.sin_port));
+    return true;
+}
+
+void ControlChannel::stop() {
+    running = false;
+
+    // Shut the socket down so a blocked recv in the channel thread — or a
+    // worker blocked in send() with the peer not reading — returns.
+    // Deliberately no write_mutex here: that blocked worker is holding it.
+    int fd = channel_socket.load();
+    if (fd >= 0) {
+        shutdown(fd, SHUT_RDWR);
+    }
+
+    queue_cv.notify_all();
+    if (channel_thread.joinable()) {
+        channel_thread.join();
+    }
+    for (auto& thread : worker_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    worker_threads.clear();
+
+    std::lock_guard<std::mutex> lock(write_mutex);
+    fd = channel_socket.exchange(-1);
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void ControlChannel::channel_function() {
+    // Dial, serve frames until the connection drops, back off, redial.
+    // The backoff doubles per consecutive failure and resets as soon as a
+    // connection is established, so a scheduler restart at 1000 nodes sees
+    // a spread of retries instead of a synchronized stampede.
+    int backoff_ms = BACKOFF_INITIAL_MS;
+
+    while (running) {
+        int fd = connect_to_scheduler();
+        if (fd >= 0 && send_hello(fd)) {
+            {
+                std::lock_guard<std::mutex> lock(write_mutex);
+                channel_socket = fd;
+            }
+            backoff_ms = BACKOFF_INITIAL_MS;
+
+            read_frames(fd);
+
+            std::lock_guard<std::mutex> lock(write_mutex);
+            channel_socket = -1;
+            close(fd);
+        } else {
+            if (fd >= 0) {
+                close(fd);
+            }
+            // Sleep in short slices so stop() isn't held up by the backoff
+            for (int waited = 0; waited < backoff_ms && running; waited += 100) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            backoff_ms = std::min(backoff_ms * 2, BACKOFF_MAX_MS);
+        }
+    }
+}
+
+int ControlChannel::connect_to_scheduler() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*)&target, sizeof(target)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Keepalive probes detect a dead peer (or an expired NAT mapping) that
+    // would otherwise leave the channel silently black-holed
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+    int idle = 30;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    return fd;
+}
+
+bool ControlChannel::send_hello(int fd) {
+    ControlHello hello;
+    memset(&hello, 0, sizeof(hello));
+    gethostname(hello.node_id, sizeof(hello.node_id) - 1);
+    hello.agent_port = (uint16_t)agent_port;
+
+    uint32_t length = sizeof(hello);
+    uint8_t opcode = OP_HELLO;
+    uint32_t request_id = 0;
+
+    // The channel socket isn't published yet, so plain writes are safe
+    return write(fd, &length, sizeof(length)) == (ssize_t)sizeof(length) &&
+           write(fd, &opcode, sizeof(opcode)) == (ssize_t)sizeof(opcode) &&
+           write(fd, &request_id, sizeof(request_id)) == (ssize_t)sizeof(request_id) &&
+           write(fd, &hello, sizeof(hello)) == (ssize_t)sizeof(hello);
+}
+
+void ControlChannel::read_frames(int fd) {
+    while (running) {
+        uint32_t payload_length = 0;
+        uint8_t opcode = 0;
+        uint32_t request_id = 0;
+
+        if (!read_exact(fd, &payload_length, sizeof(payload_length)) ||
+            !read_exact(fd, &opcode, sizeof(opcode)) ||
+            !read_exact(fd, &request_id, sizeof(request_id))) {
+            break;
+        }
+
+        // Guard against a garbage length taking the agent down
+        if (payload_length > 1024 * 1024) {
+            break;
+        }
+
+        ControlRequest request;
+        request.request_id = request_id;
+        request.opcode = opcode;
+        request.payload.resize(payload_length);
+        if (payload_length > 0 &&
+            !read_exact(fd, request.payload.data(), payload_length)) {
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (request_queue.size() >= MAX_QUEUED_REQUESTS) {
+                // Backpressure: a scheduler this far ahead of us has to
+                // wait for the in-flight commands to finish
+                queue_cv.wait(lock, [this] {
+                    return request_queue.size() < MAX_QUEUED_REQUESTS || !running;
+                });
+                if (!running) {
+                    break;
+                }
+            }
+            request_queue.push_back(std::move(request));
+        }
+        queue_cv.notify_one();
+    }
+}
+
+void ControlChannel::worker_function() {
+    std::vector<char> scratch;
+    scratch.reserve(4096);
+
+    while (running) {
+        ControlRequest request;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return !request_queue.empty() || !running; });
+            if (!running) {
+                break;
+            }
+            request = std::move(request_queue.front());
+            request_queue.pop_front();
+        }
+        queue_cv.notify_all();
+
+        handle_request(request, scratch);
+    }
+}
+
+void ControlChannel::handle_request(const ControlRequest& request,
+                                    std::vector<char>& scratch) {
+    // Payload layouts match the inbound binary protocol (binary_server.cpp);
+    // responses carry the request id so the scheduler can match them out
+    // of order
+    switch (request.opcode) {
+        case OP_STATUS_REQUEST: {
+            SystemMetrics metrics = agent.get_system_metrics();
+            std::vector<ProcessInfo> processes = agent.get_running_processes();
+
+            WireMetrics wire_metrics;
+            wire_metrics.cpu_usage = metrics.cpu_usage;
+            wire_metrics.memory_usage = metrics.memory_usage;
+            wire_metrics.total_memory = metrics.total_memory;
+            wire_metrics.available_memory = metrics.available_memory;
+            wire_metrics.process_count = processes.size();
+
+            scratch.resize(sizeof(WireMetrics) + processes.size() * sizeof(WireProcessRecord));
+            char* cursor = scratch.data();
+            memcpy(cursor, &wire_metrics, sizeof(wire_metrics));
+            cursor += sizeof(wire_metrics);
+
+            for (const auto& proc : processes) {
+                WireProcessRecord record;
+                memset(&record, 0, sizeof(record));
+                record.pid = proc.pid;
+                record.cpu_percent = proc.cpu_percent;
+                record.rss_kb = proc.rss_kb;
+                record.exit_code = proc.exit_code;
+                record.running = (proc.exit_timestamp == 0) ? 1 : 0;
+                strncpy(record.command, proc.command.c_str(), sizeof(record.command) - 1);
+
+                memcpy(cursor, &record, sizeof(record));
+                cursor += sizeof(record);
+            }
+
+            send_frame(OP_STATUS_RESPONSE, request.request_id,
+                       scratch.data(), scratch.size());
+            break;
+        }
+        case OP_START_REQUEST: {
+            // NUL-separated strings, script path first then its args
+            std::vector<std::string> parts;
+            size_t start = 0;
+            for (size_t i = 0; i < request.payload.size(); ++i) {
+                if (request.payload[i] == '\0') {
+                    parts.emplace_back(request.payload.data() + start, i - start);
+                    start = i + 1;
+                }
+            }
+            if (start < request.payload.size()) {
+                parts.emplace_back(request.payload.data() + start,
+                                   request.payload.size() - start);
+            }
+
+            int32_t pid = -1;
+            if (!parts.empty() && !parts[0].empty()) {
+                LaunchRequest launch;
+                launch.script_path = parts[0];
+                launch.args.assign(parts.begin() + 1, parts.end());
+                pid = agent.start_process_batch({launch})[0].pid;
+            }
+
+            send_frame(OP_START_RESPONSE, request.request_id, &pid, sizeof(pid));
+            break;
+        }
+        case OP_STOP_REQUEST: {
+            uint8_t success = 0;
+            if (request.payload.size() >= sizeof(int32_t)) {
+                int32_t pid;
+                memcpy(&pid, request.payload.data(), sizeof(pid));
+                success = agent.stop_process(pid) ? 1 : 0;
+            }
+
+            send_frame(OP_STOP_RESPONSE, request.request_id, &success, sizeof(success));
+            break;
+        }
+        default:
+            // Unknown opcode: ignore rather than kill the channel, so a
+            // newer scheduler can probe for features
+            break;
+    }
+}
+
+bool ControlChannel::read_exact(int fd, void* buffer, size_t length) {
+    char* cursor = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t bytes_read = recv(fd, cursor, length, 0);
+        if (bytes_read <= 0) {
+            return false;
+        }
+        cursor += bytes_read;
+        length -= bytes_read;
+    }
+    return true;
+}
+
+// Caller holds write_mutex
+bool ControlChannel::write_exact_locked(const void* buffer, size_t length) {
+    int fd = channel_socket.load();
+    if (fd < 0) {
+        return false;
+    }
+    const char* cursor = static_cast<const char*>(buffer);
+    while (length > 0) {
+        ssize_t bytes_sent = send(fd, cursor, length, MSG_NOSIGNAL);
+        if (bytes_sent <= 0) {
+            return false;
+        }
+        cursor += bytes_sent;
+        length -= bytes_sent;
+    }
+    return true;
+}
+
+bool ControlChannel::send_frame(uint8_t opcode, uint32_t request_id,
+                                const void* payload, uint32_t length) {
+    // Serialized so concurrent workers never interleave frames; if the
+    // connection died while the command ran, the response is dropped (the
+    // scheduler retries over the new connection)
+    std::lock_guard<std::mutex> lock(write_mutex);
+    if (channel_socket < 0) {
+        return false;
+    }
+    return write_exact_locked(&length, sizeof(length)) &&
+           write_exact_locked(&opcode, sizeof(opcode)) &&
+           write_exact_locked(&request_id, sizeof(request_id)) &&
+           (length == 0 || write_exact_locked(payload, length));
+}
@@ -0,0 +1,95 @@
+#ifndef CONTROL_CHANNEL_H
+#define CONTROL_CHANNEL_H
+
+#include "node_agent.h"
+#include "binary_server.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <thread>
+
+// Agent-initiated persistent control channel. Instead of the scheduler
+// dialing in for every command, the agent dials out once to
+// NODE_AGENT_CONTROL_TARGET ("host:port") and keeps the connection up,
+// reconnecting with exponential backoff. Commands arrive multiplexed over
+// that single socket and are tagged with a request id, so the scheduler
+// can pipeline without waiting and match responses out of order. Works
+// through NAT/firewalls that block inbound connections, and replaces
+// per-command connection churn with one long-lived socket per agent.
+//
+// Framing reuses the binary protocol's opcodes and payload layouts
+// (binary_server.h), with a request id added to every frame header:
+// little-endian [uint32 payload_length][uint8 opcode][uint32 request_id].
+// The agent opens with an OP_HELLO frame identifying itself.
+
+#pragma pack(push, 1)
+struct ControlHello {
+    char node_id[32];   // hostname, NUL-terminated/truncated
+    uint16_t agent_port;
+};
+#pragma pack(pop)
+
+class ControlChannel {
+private:
+    NodeAgent& agent;
+    int agent_port;
+    std::atomic<bool> running;
+
+    // Scheduler endpoint from NODE_AGENT_CONTROL_TARGET; channel is
+    // disabled (start() is a no-op) when the variable is unset
+    struct sockaddr_in target;
+    bool target_configured;
+
+    // Connected socket, or -1 between attempts. Writes (responses from the
+    // workers, each a single frame) are serialized by write_mutex; a stale
+    // response whose connection died is dropped rather than sent down the
+    // replacement socket. The fd itself is atomic so stop() can shut the
+    // socket down without taking write_mutex — a worker blocked in send()
+    // holds that mutex, and the shutdown is what unblocks it.
+    std::atomic<int> channel_socket;
+    std::mutex write_mutex;
+
+    // Reconnect backoff bounds (doubles per failure, resets on connect)
+    static constexpr int BACKOFF_INITIAL_MS = 1000;
+    static constexpr int BACKOFF_MAX_MS = 60000;
+
+    // One command pulled off the channel, queued for a worker
+    struct ControlRequest {
+        uint32_t request_id;
+        uint8_t opcode;
+        std::vector<char> payload;
+    };
+
+    // Reader thread parses frames and feeds this bounded queue; workers
+    // execute commands and send tagged responses, so a slow /start doesn't
+    // block status polls arriving behind it.
+    std::thread channel_thread;
+    std::vector<std::thread> worker_threads;
+    std::deque<ControlRequest> request_queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    static const int WORKER_THREADS = 2;
+    static constexpr size_t MAX_QUEUED_REQUESTS = 64;
+
+    void channel_function();
+    void worker_function();
+    int connect_to_scheduler();
+    bool send_hello(int fd);
+    void read_frames(int fd);
+
+    bool read_exact(int fd, void* buffer, size_t length);
+    bool write_exact_locked(const void* buffer, size_t length);
+    bool send_frame(uint8_t opcode, uint32_t request_id,
+                    const void* payload, uint32_t length);
+
+    void handle_request(const ControlRequest& request, std::vector<char>& scratch);
+
+public:
+    ControlChannel(NodeAgent& agent, int agent_port);
+    ~ControlChannel();
+
+    bool start();
+    void stop();
+};
+
+#endif // CONTROL_CHANNEL_H
@@ -0,0 +1,266 @@
+#include "handoff.h"
+#include "async_log.h"
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::string handoff_socket_path(int port) {
+    const char* path_env = getenv("NODE_AGENT_HANDOFF_SOCKET");
+    if (path_env != nullptr && path_env[0] != '\0') {
+        return path_env;
+    }
+    return "/tmp/node_agent_" + std::to_string(port) + ".handoff";
+}
+
+bool handoff_receive(int port, std::vector<int>& http_fds, int& binary_fd) {
+    std::string path = handoff_socket_path(port);
+
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        return false; // no predecessor waiting
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        // A socket file with nobody behind it is debris from a crashed
+        // predecessor; clear it so this agent can drain cleanly later
+        if (errno == ECONNREFUSED) {
+            unlink(path.c_str());
+        }
+        close(fd);
+        return false;
+    }
+
+    // One recvmsg carries the header and every descriptor
+    HandoffHeader header;
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+
+    char control[CMSG_SPACE(16 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (received != (ssize_t)sizeof(header) || header.magic != HANDOFF_MAGIC ||
+        header.agent_port != (uint16_t)port) {
+        log_warn("Ignoring malformed handoff from predecessor on %s", path.c_str());
+        close(fd);
+        return false;
+    }
+
+    std::vector<int> fds;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* data = (const int*)CMSG_DATA(cmsg);
+            fds.insert(fds.end(), data, data + count);
+        }
+    }
+
+    if (fds.size() != (size_t)header.http_listener_count + header.binary_listener_count) {
+        log_warn("Handoff descriptor count mismatch (%zu received); starting fresh",
+                 fds.size());
+        for (int received_fd : fds) {
+            close(received_fd);
+        }
+        close(fd);
+        return false;
+    }
+
+    http_fds.assign(fds.begin(), fds.begin() + header.http_listener_count);
+    binary_fd = (header.binary_listener_count > 0) ? fds[header.http_listener_count] : -1;
+
+    // Ack tells the predecessor it can stop accepting and wind down
+    char ack = 'K';
+    ssize_t sent = send(fd, &ack, 1, MSG_NOSIGNAL);
+    (void)sent;
+    close(fd);
+    unlink(path.c_str());
+
+    return true;
+}
+
+HandoffServer::HandoffServer(NodeAgent& agent, HttpServer& http_server,
+                             BinaryServer& binary_server, int port)
+    : agent(agent), http_server(http_server), binary_server(binary_server),
+      agent_port(port), listen_fd(-1), active(false), handoff_complete(false) {
+}
+
+HandoffServer::~HandoffServer() {
+    stop();
+}
+
+std::string HandoffServer::begin() {
+    bool expected = false;
+    if (!active.compare_exchange_strong(expected, true)) {
+        return socket_path; // already draining; /drain is idempotent
+    }
+
+    socket_path = handoff_socket_path(agent_port);
+    unlink(socket_path.c_str()); // clear debris from a crashed drain
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        active = false;
+        return "";
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 1) < 0) {
+        log_error("Error creating handoff socket %s", socket_path.c_str());
+        close(listen_fd);
+        listen_fd = -1;
+        active = false;
+        return "";
+    }
+
+    serve_thread = std::thread(&HandoffServer::serve_function, this);
+    log_info("Draining: waiting for successor on %s", socket_path.c_str());
+    return socket_path;
+}
+
+void HandoffServer::stop() {
+    active = false;
+    if (serve_thread.joinable()) {
+        serve_thread.join();
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+void HandoffServer::serve_function() {
+    // Poll so stop() isn't held hostage by a successor that never comes
+    while (active) {
+        struct pollfd pfd;
+        pfd.fd = listen_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            continue;
+        }
+
+        // Launches this agent already admitted (the caller holds a queued
+        // id) must reach the table before the successor recovers it, or
+        // they die with this process. Hold the transfer — the successor
+        // waits in recvmsg, and this agent is still serving — until the
+        // dispatcher has flushed the queue at its configured rate.
+        int waited_ms = 0;
+        while (active && agent.get_launch_queue_depth() > 0 &&
+               waited_ms < QUEUE_FLUSH_TIMEOUT_MS) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            waited_ms += 50;
+        }
+        size_t abandoned = agent.get_launch_queue_depth();
+        if (abandoned > 0) {
+            log_warn("Handoff leaving %zu admitted launch(es) undispatched",
+                     abandoned);
+        }
+
+        if (transfer_listeners(client_fd)) {
+            close(client_fd);
+
+            // The successor owns the accept queues now. Linger so
+            // responses already in flight here finish flushing, then let
+            // main run the normal shutdown path. Tracked workloads keep
+            // running; the successor recovers them from the table file.
+            std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_LINGER_MS));
+            log_info("Handoff complete; shutting down");
+            handoff_complete = true;
+            return;
+        }
+
+        // Failed or unacknowledged transfer: keep serving and keep
+        // waiting — the operator retries the new binary
+        close(client_fd);
+        http_server.resume_accepting();
+    }
+}
+
+bool HandoffServer::transfer_listeners(int client_fd) {
+    std::vector<int> fds = http_server.listener_fds();
+    size_t http_count = fds.size();
+    int binary_fd = binary_server.listener_fd();
+    if (binary_fd >= 0) {
+        fds.push_back(binary_fd);
+    }
+
+    HandoffHeader header;
+    header.magic = HANDOFF_MAGIC;
+    header.agent_port = (uint16_t)agent_port;
+    header.http_listener_count = (uint8_t)http_count;
+    header.binary_listener_count = (binary_fd >= 0) ? 1 : 0;
+
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+
+    char control[CMSG_SPACE(16 * sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+
+    if (sendmsg(client_fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(header)) {
+        log_warn("Handoff sendmsg failed; keeping listeners");
+        return false;
+    }
+
+    // Stop accepting the moment the descriptors are on the wire: new
+    // connections queue in the kernel until the successor arms its epoll
+    http_server.stop_accepting();
+
+    // Wait for the ack confirming the successor adopted the descriptors
+    struct timeval timeout = {ACK_TIMEOUT_SECONDS, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char ack = 0;
+    if (recv(client_fd, &ack, 1, 0) != 1 || ack != 'K') {
+        log_warn("Successor never acknowledged handoff; resuming");
+        return false;
+    }
+
+    // The successor is accepting; retire our copy of the binary listener
+    // (its transferred duplicate is unaffected)
+    binary_server.stop_server();
+    return true;
+}
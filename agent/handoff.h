@@ -0,0 +1,77 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "http_server.h"
+#include "binary_server.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Zero-downtime upgrade handoff. POST /drain puts the old agent into
+// drain mode and opens a Unix listener at /tmp/node_agent_<port>.handoff
+// (override: NODE_AGENT_HANDOFF_SOCKET). A newly exec'd agent binary for
+// the same port connects there on startup and receives the HTTP and
+// binary listening descriptors over SCM_RIGHTS, so the kernel's accept
+// queues — and any connections already parked in them — move to the new
+// process without a listening gap. Workload state rides the existing
+// persistent table file (both binaries derive the same path from the
+// port), so the successor recovers every tracked pid without restarting
+// anything.
+
+#pragma pack(push, 1)
+struct HandoffHeader {
+    uint32_t magic; // HANDOFF_MAGIC, guards against a stray connector
+    uint16_t agent_port;
+    uint8_t http_listener_count;
+    uint8_t binary_listener_count;
+};
+#pragma pack(pop)
+
+static const uint32_t HANDOFF_MAGIC = 0x3148414E; // "NAH1"
+
+// Path of the handoff socket for an agent on the given port
+std::string handoff_socket_path(int port);
+
+// Successor side: if a draining predecessor is waiting on the handoff
+// socket, take its listeners and acknowledge. Returns true when
+// descriptors were adopted. Call before the servers create their own.
+bool handoff_receive(int port, std::vector<int>& http_fds, int& binary_fd);
+
+// Predecessor side, owned by main. begin() (idempotent, invoked by the
+// /drain handler) opens the handoff socket and waits for a successor in
+// a background thread; once the descriptors are acknowledged the old
+// agent stops accepting, lingers briefly so in-flight responses flush,
+// and completed() flips so main can shut down.
+class HandoffServer {
+private:
+    NodeAgent& agent;
+    HttpServer& http_server;
+    BinaryServer& binary_server;
+    int agent_port;
+    int listen_fd;
+    std::string socket_path;
+    std::atomic<bool> active;
+    std::atomic<bool> handoff_complete;
+    std::thread serve_thread;
+
+    static const int ACK_TIMEOUT_SECONDS = 5;
+    static const int DRAIN_LINGER_MS = 1000;
+    static const int QUEUE_FLUSH_TIMEOUT_MS = 120000;
+
+    void serve_function();
+    bool transfer_listeners(int client_fd);
+
+public:
+    HandoffServer(NodeAgent& agent, HttpServer& http_server,
+                  BinaryServer& binary_server, int port);
+    ~HandoffServer();
+
+    // Returns the handoff socket path, or an empty string if the
+    // listener could not be created
+    std::string begin();
+    bool completed() const { return handoff_complete; }
+    void stop();
+};
+
+#endif // HANDOFF_H
@@ -0,0 +1,180 @@
+#include "http_parser.h"
+#include <cctype>
+#include <cstdlib>
+
+HttpParser::HttpParser() {
+    header_spans.reserve(16);
+    reset();
+}
+
+void HttpParser::reset() {
+    state = State::REQUEST_LINE;
+    parse_offset = 0;
+    line_start = 0;
+    body_offset = 0;
+    content_length = 0;
+    method_span = {0, 0};
+    path_span = {0, 0};
+    version_span = {0, 0};
+    header_spans.clear();
+    base = nullptr;
+}
+
+bool HttpParser::parse(const std::string& buffer) {
+    if (state == State::COMPLETE) {
+        return true;
+    }
+    if (state == State::ERROR) {
+        return false;
+    }
+
+    // Header phase: scan for line endings from where we left off
+    while (state == State::REQUEST_LINE || state == State::HEADERS) {
+        size_t i = parse_offset;
+        while (i < buffer.length() && buffer[i] != '\n') {
+            ++i;
+        }
+        if (i > MAX_HEADER_BYTES) {
+            state = State::ERROR;
+            return false;
+        }
+        if (i >= buffer.length()) {
+            parse_offset = i;
+            return false; // need more bytes
+        }
+
+        // Line is [line_start, i), minus a trailing \r
+        size_t line_end = i;
+        if (line_end > line_start && buffer[line_end - 1] == '\r') {
+            --line_end;
+        }
+        size_t line_offset = line_start;
+        size_t line_length = line_end - line_start;
+
+        parse_offset = i + 1;
+        line_start = parse_offset;
+
+        if (state == State::REQUEST_LINE) {
+            if (!parse_request_line(buffer, line_offset, line_length)) {
+                state = State::ERROR;
+                return false;
+            }
+            state = State::HEADERS;
+        } else if (line_length == 0) {
+            // Blank line terminates the headers
+            if (content_length > MAX_BODY_BYTES) {
+                state = State::ERROR;
+                return false;
+            }
+            body_offset = parse_offset;
+            state = (content_length > 0) ? State::BODY : State::COMPLETE;
+        } else {
+            parse_header_line(buffer, line_offset, line_length);
+        }
+    }
+
+    if (state == State::BODY) {
+        if (buffer.length() < body_offset + content_length) {
+            return false; // body still arriving
+        }
+        state = State::COMPLETE;
+    }
+
+    base = buffer.data();
+    return true;
+}
+
+bool HttpParser::parse_request_line(const std::string& buffer, size_t offset, size_t length) {
+    std::string_view line(buffer.data() + offset, length);
+
+    size_t method_end = line.find(' ');
+    if (method_end == std::string_view::npos) {
+        return false;
+    }
+    size_t path_end = line.find(' ', method_end + 1);
+    if (path_end == std::string_view::npos) {
+        return false;
+    }
+
+    method_span = {offset, method_end};
+    path_span = {offset + method_end + 1, path_end - method_end - 1};
+    version_span = {offset + path_end + 1, length - path_end - 1};
+    return true;
+}
+
+void HttpParser::parse_header_line(const std::string& buffer, size_t offset, size_t length) {
+    std::string_view line(buffer.data() + offset, length);
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return; // malformed header line; skip it
+    }
+
+    size_t value_start = colon + 1;
+    while (value_start < length && (line[value_start] == ' ' || line[value_start] == '\t')) {
+        ++value_start;
+    }
+    size_t value_end = length;
+    while (value_end > value_start &&
+           (line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) {
+        --value_end;
+    }
+
+    HeaderSpan span;
+    span.name = {offset, colon};
+    span.value = {offset + value_start, value_end - value_start};
+    header_spans.push_back(span);
+
+    // Content-Length decides when the body phase ends; grab it as we pass
+    std::string_view name = line.substr(0, colon);
+    if (name.length() == 14) {
+        static const char target[] = "content-length";
+        bool match = true;
+        for (size_t i = 0; i < 14; ++i) {
+            if (std::tolower((unsigned char)name[i]) != target[i]) {
+                match = false;
+                break;
+            }
+        }
+        if (match) {
+            content_length = std::strtoul(buffer.c_str() + offset + value_start, nullptr, 10);
+        }
+    }
+}
+
+std::string_view HttpParser::method() const {
+    return std::string_view(base + method_span.offset, method_span.length);
+}
+
+std::string_view HttpParser::path() const {
+    return std::string_view(base + path_span.offset, path_span.length);
+}
+
+std::string_view HttpParser::version() const {
+    return std::string_view(base + version_span.offset, version_span.length);
+}
+
+std::string_view HttpParser::body() const {
+    return std::string_view(base + body_offset, content_length);
+}
+
+std::string_view HttpParser::header(std::string_view name) const {
+    for (const auto& span : header_spans) {
+        std::string_view header_name(base + span.name.offset, span.name.length);
+        if (header_name.length() != name.length()) {
+            continue;
+        }
+        bool match = true;
+        for (size_t i = 0; i < name.length(); ++i) {
+            if (std::tolower((unsigned char)header_name[i]) !=
+                std::tolower((unsigned char)name[i])) {
+                match = false;
+                break;
+            }
+        }
+        if (match) {
+            return std::string_view(base + span.value.offset, span.value.length);
+        }
+    }
+    return std::string_view();
+}
@@ -0,0 +1,82 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Incremental HTTP/1.1 request parser. Feed it the connection's receive
+// buffer after every recv; it resumes from where it stopped, so each byte
+// is scanned once. Fields are stored as offset/length pairs into the
+// buffer and exposed as string_view without copying, so parsing a request
+// performs no allocations (beyond the header vector's warmed-up capacity).
+class HttpParser {
+public:
+    enum class State {
+        REQUEST_LINE,
+        HEADERS,
+        BODY,
+        COMPLETE,
+        ERROR
+    };
+
+    // Hard caps on client-supplied sizes. A Content-Length beyond the body
+    // cap (or an endless header section) moves the parser to ERROR instead
+    // of letting the receive buffer grow to whatever the client claims.
+    static constexpr size_t MAX_BODY_BYTES = 1024 * 1024;
+    static constexpr size_t MAX_HEADER_BYTES = 16 * 1024;
+
+private:
+    struct Span {
+        size_t offset;
+        size_t length;
+    };
+
+    struct HeaderSpan {
+        Span name;
+        Span value;
+    };
+
+    State state;
+    size_t parse_offset;   // next unexamined byte
+    size_t line_start;     // start of the line being scanned
+    size_t body_offset;
+    size_t content_length;
+
+    Span method_span;
+    Span path_span;
+    Span version_span;
+    std::vector<HeaderSpan> header_spans;
+
+    const char* base; // buffer data pointer, captured on completion
+
+    bool parse_request_line(const std::string& buffer, size_t offset, size_t length);
+    void parse_header_line(const std::string& buffer, size_t offset, size_t length);
+
+public:
+    HttpParser();
+
+    // Start over for the next request on the same connection (the header
+    // vector keeps its capacity)
+    void reset();
+
+    // Advance the state machine over the buffer. Returns true once a full
+    // request (headers + body) is buffered. Safe to call repeatedly.
+    bool parse(const std::string& buffer);
+
+    State get_state() const { return state; }
+
+    // Total bytes of the complete request, so the caller can consume them
+    size_t request_length() const { return body_offset + content_length; }
+
+    // Accessors are valid after parse() returned true and until the buffer
+    // is modified
+    std::string_view method() const;
+    std::string_view path() const;
+    std::string_view version() const;
+    std::string_view body() const;
+    std::string_view header(std::string_view name) const; // case-insensitive
+};
+
+#endif // HTTP_PARSER_H
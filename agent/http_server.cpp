@@ -1,277 +1,1156 @@
 #include "http_server.h"
+#include "instrumentation.h"
+#include "async_log.h"
 #include <sstream>
 #include <algorithm>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <pthread.h>
+#include <errno.h>
 
 HttpServer::HttpServer(NodeAgent& agent, int port) : agent(agent), port(port), running(false) {
-    server_socket = -1;
 }
 
 HttpServer::~HttpServer() {
     stop_server();
 }
 
+// Listen backlog shared by the agent's TCP listeners; deep enough to ride
+// out a scheduler-restart reconnect storm without SYN overflows
+static int configured_backlog() {
+    const char* value = getenv("NODE_AGENT_LISTEN_BACKLOG");
+    int backlog = (value != nullptr) ? atoi(value) : 0;
+    return backlog > 0 ? backlog : 512;
+}
+
 bool HttpServer::start_server() {
-    // Create socket
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket < 0) {
-        std::cerr << "Error creating HTTP server socket" << std::endl;
-        return false;
+    // The dispatch table's binary search depends on (method, segment)
+    // order; refuse to start if a new endpoint was registered out of place
+    for (size_t i = 1; i < ROUTE_TABLE_SIZE; ++i) {
+        const RouteEntry& prev = ROUTE_TABLE[i - 1];
+        const RouteEntry& row = ROUTE_TABLE[i];
+        if (row.method < prev.method ||
+            (row.method == prev.method && row.segment <= prev.segment)) {
+            log_error("Route table misordered at entry %zu (%.*s %.*s)", i,
+                      (int)row.method.size(), row.method.data(),
+                      (int)row.segment.size(), row.segment.data());
+            return false;
+        }
     }
-    
-    // Set socket options
-    int opt = 1;
-    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "Error setting HTTP server socket options" << std::endl;
-        return false;
+
+    int backlog = configured_backlog();
+
+    // Listeners handed off by a draining predecessor are already bound
+    // and listening — adopting them keeps their accept queues intact
+    if (adopted_listeners.size() == (size_t)EVENT_LOOP_THREADS) {
+        for (int fd : adopted_listeners) {
+            int flags = fcntl(fd, F_GETFL, 0);
+            if (flags >= 0) {
+                fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+            }
+            listen_sockets.push_back(fd);
+        }
+        adopted_listeners.clear();
+        running = true;
+        log_info("HTTP Server adopted %d listener(s) on port %d from predecessor",
+                 EVENT_LOOP_THREADS, port);
+        return true;
     }
-    
-    // Bind socket
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
-    
-    if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        std::cerr << "Error binding HTTP server socket" << std::endl;
-        return false;
+    for (int fd : adopted_listeners) {
+        close(fd); // count mismatch (different build?); start fresh
     }
-    
-    // Listen for connections
-    if (listen(server_socket, 10) < 0) {
-        std::cerr << "Error listening on HTTP server socket" << std::endl;
-        return false;
+    adopted_listeners.clear();
+
+    // One SO_REUSEPORT listening socket per event loop; the kernel hashes
+    // incoming connections across them
+    for (int i = 0; i < EVENT_LOOP_THREADS; ++i) {
+        int listen_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_socket < 0) {
+            log_error("Error creating HTTP server socket");
+            stop_server();
+            return false;
+        }
+
+        int opt = 1;
+        if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+            setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            log_error("Error setting HTTP server socket options");
+            close(listen_socket);
+            stop_server();
+            return false;
+        }
+
+        // Non-blocking so the event loops can accept without stalling
+        int flags = fcntl(listen_socket, F_GETFL, 0);
+        if (flags < 0 || fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+            log_error("Error setting HTTP server socket non-blocking");
+            close(listen_socket);
+            stop_server();
+            return false;
+        }
+
+        struct sockaddr_in server_addr;
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(port);
+
+        if (bind(listen_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            log_error("Error binding HTTP server socket");
+            close(listen_socket);
+            stop_server();
+            return false;
+        }
+
+        if (listen(listen_socket, backlog) < 0) {
+            log_error("Error listening on HTTP server socket");
+            close(listen_socket);
+            stop_server();
+            return false;
+        }
+
+        listen_sockets.push_back(listen_socket);
     }
-    
+
     running = true;
-    std::cout << "HTTP Server started on port " << port << std::endl;
+    log_info("HTTP Server started on port %d (%d acceptors, backlog %d)",
+             port, EVENT_LOOP_THREADS, backlog);
     return true;
 }
 
 void HttpServer::stop_server() {
     running = false;
-    if (server_socket >= 0) {
-        close(server_socket);
-        server_socket = -1;
+    for (int listen_socket : listen_sockets) {
+        close(listen_socket);
+    }
+    listen_sockets.clear();
+
+    // Wait for event loop threads to drain and exit
+    for (auto& thread : event_loop_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    event_loop_threads.clear();
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (HttpConnection* conn : connection_pool) {
+        delete conn;
+    }
+    connection_pool.clear();
+}
+
+HttpConnection* HttpServer::acquire_connection(int fd) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (!connection_pool.empty()) {
+            HttpConnection* conn = connection_pool.back();
+            connection_pool.pop_back();
+            conn->reset(fd);
+            return conn;
+        }
+    }
+    return new HttpConnection(fd);
+}
+
+void HttpServer::release_connection(HttpConnection* conn) {
+    // Don't let one huge request pin a huge buffer in the pool forever
+    if (conn->read_buffer.capacity() > POOLED_BUFFER_LIMIT) {
+        std::string().swap(conn->read_buffer);
+    }
+
+    // Abandoned mid-sendfile responses still hold the log file open
+    if (conn->file_fd >= 0) {
+        close(conn->file_fd);
+        conn->file_fd = -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (connection_pool.size() < MAX_POOLED_CONNECTIONS) {
+            connection_pool.push_back(conn);
+            return;
+        }
+    }
+    delete conn;
+}
+
+void HttpServer::stop_accepting() {
+    // Detach each loop's listener from its epoll set. The sockets stay
+    // open — their accept queues (and any connections parked in them)
+    // belong to the handoff successor from here on. epoll_ctl is safe to
+    // call from outside the loop threads.
+    for (int i = 0; i < EVENT_LOOP_THREADS && i < (int)loop_epoll_fds.size(); ++i) {
+        if (loop_epoll_fds[i] >= 0 && i < (int)listen_sockets.size()) {
+            epoll_ctl(loop_epoll_fds[i], EPOLL_CTL_DEL, listen_sockets[i], nullptr);
+        }
+    }
+    log_info("HTTP Server stopped accepting on port %d (handoff)", port);
+}
+
+void HttpServer::resume_accepting() {
+    // Aborted handoff: re-arm the listeners (EEXIST means a loop never
+    // lost its listener, which is fine)
+    for (int i = 0; i < EVENT_LOOP_THREADS && i < (int)loop_epoll_fds.size(); ++i) {
+        if (loop_epoll_fds[i] >= 0 && i < (int)listen_sockets.size()) {
+            struct epoll_event listen_event;
+            listen_event.events = EPOLLIN;
+            listen_event.data.ptr = nullptr;
+            epoll_ctl(loop_epoll_fds[i], EPOLL_CTL_ADD, listen_sockets[i],
+                      &listen_event);
+        }
     }
 }
 
 void HttpServer::run_server() {
+    // Spawn a fixed set of event loop threads. Connections are handled as
+    // non-blocking state machines inside each loop, so in-flight requests
+    // cost a small buffer instead of a dedicated thread stack.
+    loop_epoll_fds.assign(EVENT_LOOP_THREADS, -1);
+    for (int i = 0; i < EVENT_LOOP_THREADS; ++i) {
+        event_loop_threads.emplace_back(&HttpServer::event_loop, this, i);
+    }
+}
+
+void HttpServer::event_loop(int loop_index) {
+    // Pin the loop to a core so its listener's connections stay local
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores > 1) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(loop_index % cores, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    }
+
+    int listen_socket = listen_sockets[loop_index];
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        log_error("Error creating epoll instance");
+        return;
+    }
+    loop_epoll_fds[loop_index] = epoll_fd;
+
+    // Register this loop's own listening socket. data.ptr == nullptr marks
+    // it so we can tell accept events apart from connection events.
+    struct epoll_event listen_event;
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_socket, &listen_event) < 0) {
+        log_error("Error registering listen socket with epoll");
+        close(epoll_fd);
+        return;
+    }
+
+    const int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, 500);
+        if (num_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (running) {
+                log_error("Error in epoll_wait");
+            }
+            break;
+        }
+
+        for (int i = 0; i < num_events; ++i) {
+            HttpConnection* conn = static_cast<HttpConnection*>(events[i].data.ptr);
+
+            if (conn == nullptr) {
+                accept_connections(epoll_fd, listen_socket);
+                continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                close_connection(epoll_fd, conn);
+                continue;
+            }
+
+            bool keep_open = true;
+            if (events[i].events & EPOLLIN) {
+                keep_open = handle_readable(epoll_fd, conn);
+            }
+            if (keep_open && (events[i].events & EPOLLOUT)) {
+                keep_open = handle_writable(epoll_fd, conn);
+            }
+
+            if (!keep_open) {
+                close_connection(epoll_fd, conn);
+            }
+        }
+    }
+
+    close(epoll_fd);
+}
+
+void HttpServer::accept_connections(int epoll_fd, int listen_socket) {
+    // Drain the accept queue; the socket is non-blocking so we stop on EAGAIN
     while (running) {
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
-        
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
+
+        int client_socket = accept4(listen_socket, (struct sockaddr*)&client_addr,
+                                    &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_socket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
             if (running) {
-                std::cerr << "Error accepting HTTP connection" << std::endl;
+                log_error("Error accepting HTTP connection");
             }
-            continue;
+            break;
+        }
+
+        AgentMetrics::instance().connections_accepted.fetch_add(1, std::memory_order_relaxed);
+
+        HttpConnection* conn = acquire_connection(client_socket);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+            log_error("Error registering connection with epoll");
+            close(client_socket);
+            release_connection(conn);
         }
-        
-        // Handle client in a separate thread
-        std::thread client_thread(&HttpServer::handle_client, this, client_socket);
-        client_thread.detach();
     }
 }
 
-void HttpServer::handle_client(int client_socket) {
-    std::string request = read_request(client_socket);
-    if (request.empty()) {
-        close(client_socket);
-        return;
-    }
-    
-    // Parse HTTP request
-    std::istringstream request_stream(request);
-    std::string method, path, version;
-    request_stream >> method >> path >> version;
-    
-    // Read headers
-    std::string line;
-    std::map<std::string, std::string> headers;
-    while (std::getline(request_stream, line) && line != "\r" && line != "") {
-        if (line.back() == '\r') line.pop_back();
-        if (line.empty()) break;
-        
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string key = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 1);
-            // Trim whitespace
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t") + 1);
-            headers[key] = value;
-        }
-    }
-    
-    // Read body
-    std::string body;
-    if (headers.find("Content-Length") != headers.end()) {
-        int content_length = std::stoi(headers["Content-Length"]);
-        char* buffer = new char[content_length + 1];
-        int bytes_read = recv(client_socket, buffer, content_length, 0);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            body = std::string(buffer);
-        }
-        delete[] buffer;
-    }
-    
-    // Route request
-    std::string response;
-    if (method == "GET" && path == "/status") {
-        response = handle_status_request();
-    } else if (method == "POST" && path == "/start") {
-        response = handle_start_request(body);
-    } else if (method == "POST" && path == "/stop") {
-        response = handle_stop_request(body);
-    } else {
-        response = create_error_response("Not Found", 404);
-    }
-    
-    send_response(client_socket, response);
-    close(client_socket);
-}
-
-std::string HttpServer::read_request(int client_socket) {
+bool HttpServer::handle_readable(int epoll_fd, HttpConnection* conn) {
     char buffer[4096];
-    std::string request;
-    
+
     while (true) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_received <= 0) {
-            break;
+        int bytes_received = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (bytes_received > 0) {
+            conn->read_buffer.append(buffer, bytes_received);
+            continue;
+        }
+        if (bytes_received == 0) {
+            // Peer closed the connection
+            return false;
         }
-        
-        request += std::string(buffer, bytes_received);
-        
-        // Check if we've received the complete request
-        if (request.find("\r\n\r\n") != std::string::npos) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
             break;
         }
+        return false;
     }
-    
-    return request;
-}
 
-void HttpServer::send_response(int client_socket, const std::string& response) {
-    send(client_socket, response.c_str(), response.length(), 0);
+    if (conn->response_in_flight) {
+        // Still draining the previous response; the new bytes wait in
+        // read_buffer until the flush completes
+        return true;
+    }
+
+    return process_buffered_requests(epoll_fd, conn);
 }
 
-std::string HttpServer::create_json_response(const std::string& data, int status_code) {
-    std::string status_text;
+// Formats the response header block; returns its length
+static size_t build_response_header(char* buffer, size_t capacity, int status_code,
+                                    const char* content_type, size_t content_length) {
+    const char* status_text;
     switch (status_code) {
         case 200: status_text = "OK"; break;
         case 400: status_text = "Bad Request"; break;
         case 404: status_text = "Not Found"; break;
         case 500: status_text = "Internal Server Error"; break;
+        case 503: status_text = "Service Unavailable"; break;
         default: status_text = "Unknown"; break;
     }
-    
-    std::ostringstream response;
-    response << "HTTP/1.1 " << status_code << " " << status_text << "\r\n";
-    response << "Content-Type: application/json\r\n";
-    response << "Content-Length: " << data.length() << "\r\n";
-    response << "Access-Control-Allow-Origin: *\r\n";
-    response << "Access-Control-Allow-Methods: GET, POST, DELETE\r\n";
-    response << "Access-Control-Allow-Headers: Content-Type\r\n";
-    response << "\r\n";
-    response << data;
-    
-    return response.str();
+
+    int length = snprintf(buffer, capacity,
+                          "HTTP/1.1 %d %s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Length: %zu\r\n"
+                          "Connection: keep-alive\r\n"
+                          "Access-Control-Allow-Origin: *\r\n"
+                          "Access-Control-Allow-Methods: GET, POST, DELETE\r\n"
+                          "Access-Control-Allow-Headers: Content-Type\r\n"
+                          "\r\n",
+                          status_code, status_text, content_type, content_length);
+    return (length > 0 && (size_t)length < capacity) ? (size_t)length : 0;
+}
+
+// Header for a chunked response: no Content-Length, so the body can be
+// serialized and sent piecewise (streaming /status)
+static size_t build_chunked_response_header(char* buffer, size_t capacity,
+                                            int status_code, const char* content_type) {
+    int length = snprintf(buffer, capacity,
+                          "HTTP/1.1 %d OK\r\n"
+                          "Content-Type: %s\r\n"
+                          "Transfer-Encoding: chunked\r\n"
+                          "Connection: keep-alive\r\n"
+                          "Access-Control-Allow-Origin: *\r\n"
+                          "Access-Control-Allow-Methods: GET, POST, DELETE\r\n"
+                          "Access-Control-Allow-Headers: Content-Type\r\n"
+                          "\r\n",
+                          status_code, content_type);
+    return (length > 0 && (size_t)length < capacity) ? (size_t)length : 0;
+}
+
+bool HttpServer::process_buffered_requests(int epoll_fd, HttpConnection* conn) {
+    // Handle pipelined requests in arrival order, but parse the next one
+    // only after the previous response left the connection
+    while (!conn->response_in_flight && conn->parser.parse(conn->read_buffer)) {
+        conn->json.clear();
+        const char* content_type = "application/json";
+        int file_fd = -1;
+        size_t file_size = 0;
+        bool stream_status = false;
+        int status_code = route_request(conn->parser, conn->json, content_type,
+                                        file_fd, file_size, stream_status);
+        conn->file_fd = file_fd;
+        conn->file_offset = 0;
+        conn->file_remaining = file_size;
+
+        if (!keep_alive_requested(conn->parser)) {
+            conn->close_after_flush = true;
+        }
+        conn->read_buffer.erase(0, conn->parser.request_length());
+        conn->parser.reset();
+
+        if (stream_status) {
+            // Body is produced chunk by chunk as the socket drains
+            // (fill_status_chunk), so the header carries no length
+            conn->stream_shard = 0;
+            conn->stream_first = true;
+            conn->header_length = build_chunked_response_header(
+                conn->response_header, sizeof(conn->response_header),
+                status_code, content_type);
+        } else {
+            conn->header_length = build_response_header(conn->response_header,
+                                                        sizeof(conn->response_header),
+                                                        status_code, content_type,
+                                                        conn->json.size() + file_size);
+        }
+        conn->header_sent = 0;
+        conn->body_sent = 0;
+        conn->response_in_flight = true;
+
+        if (!flush_response(epoll_fd, conn)) {
+            return false;
+        }
+        if (conn->close_after_flush) {
+            break;
+        }
+    }
+
+    if (conn->parser.get_state() == HttpParser::State::ERROR) {
+        // Unparseable request; nothing sensible to answer
+        return false;
+    }
+
+    return true;
+}
+
+bool HttpServer::flush_response(int epoll_fd, HttpConnection* conn) {
+    const std::string& body = conn->json.str();
+
+    while (conn->response_in_flight) {
+        struct iovec iov[2];
+        int iov_count = 0;
+
+        if (conn->header_sent < conn->header_length) {
+            iov[iov_count].iov_base = conn->response_header + conn->header_sent;
+            iov[iov_count].iov_len = conn->header_length - conn->header_sent;
+            iov_count++;
+        }
+        if (conn->body_sent < body.length()) {
+            iov[iov_count].iov_base = const_cast<char*>(body.data()) + conn->body_sent;
+            iov[iov_count].iov_len = body.length() - conn->body_sent;
+            iov_count++;
+        }
+
+        if (iov_count == 0) {
+            // Header and buffered body are out; if this is a streaming
+            // /status, refill the buffer with the next chunk and go again
+            if (conn->stream_shard >= 0) {
+                if (fill_status_chunk(conn)) {
+                    conn->body_sent = 0;
+                    continue;
+                }
+                conn->stream_shard = -1;
+            }
+
+            // Stream the file tail, if any, straight from the page cache
+            // with sendfile
+            while (conn->file_remaining > 0) {
+                ssize_t sent = sendfile(conn->fd, conn->file_fd,
+                                        &conn->file_offset, conn->file_remaining);
+                if (sent < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        if (!conn->epollout_armed) {
+                            struct epoll_event event;
+                            event.events = EPOLLIN | EPOLLOUT;
+                            event.data.ptr = conn;
+                            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+                            conn->epollout_armed = true;
+                        }
+                        return true;
+                    }
+                    return false;
+                }
+                if (sent == 0) {
+                    // File shrank underneath us; nothing more to send
+                    break;
+                }
+                conn->file_remaining -= (size_t)sent;
+            }
+            if (conn->file_fd >= 0) {
+                close(conn->file_fd);
+                conn->file_fd = -1;
+            }
+            conn->response_in_flight = false;
+            break;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+
+        // sendmsg rather than writev for MSG_NOSIGNAL
+        ssize_t bytes_sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Kernel buffer is full; wait for EPOLLOUT to finish
+                if (!conn->epollout_armed) {
+                    struct epoll_event event;
+                    event.events = EPOLLIN | EPOLLOUT;
+                    event.data.ptr = conn;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+                    conn->epollout_armed = true;
+                }
+                return true;
+            }
+            return false;
+        }
+
+        size_t advanced = bytes_sent;
+        size_t header_remaining = conn->header_length - conn->header_sent;
+        if (advanced < header_remaining) {
+            conn->header_sent += advanced;
+            continue;
+        }
+        conn->header_sent = conn->header_length;
+        conn->body_sent += advanced - header_remaining;
+    }
+
+    // Fully flushed
+    if (conn->close_after_flush) {
+        return false;
+    }
+
+    if (conn->epollout_armed) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->epollout_armed = false;
+    }
+    return true;
+}
+
+bool HttpServer::handle_writable(int epoll_fd, HttpConnection* conn) {
+    if (!flush_response(epoll_fd, conn)) {
+        return false;
+    }
+    if (conn->response_in_flight) {
+        return true;
+    }
+    // Response done; pick up any pipelined requests that were waiting
+    return process_buffered_requests(epoll_fd, conn);
+}
+
+bool HttpServer::keep_alive_requested(const HttpParser& parser) {
+    // HTTP/1.1 defaults to persistent connections; HTTP/1.0 must opt in
+    std::string_view connection = parser.header("Connection");
+
+    if (connection == "close" || connection == "Close") {
+        return false;
+    }
+    if (connection == "keep-alive" || connection == "Keep-Alive") {
+        return true;
+    }
+
+    return parser.version() != "HTTP/1.0";
+}
+
+void HttpServer::close_connection(int epoll_fd, HttpConnection* conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    release_connection(conn);
+}
+
+// Route adapters: thin uniform-signature shims between the dispatch
+// table and the handlers. POST bodies are materialized here for the JSON
+// field parser; GET paths never touch the heap.
+
+int HttpServer::route_status(const RouteContext& ctx, JsonWriter& json) {
+    // ?stream=1 selects chunked output: nothing is serialized here, the
+    // connection pulls the body shard by shard as the socket drains
+    if (ctx.query.find("stream=1") != std::string_view::npos) {
+        AgentMetrics::instance().count_request(AgentMetrics::ROUTE_STATUS);
+        *ctx.stream_status = true;
+        return 200;
+    }
+
+    // ?since=<seq> selects the incremental delta form
+    size_t since_pos = ctx.query.find("since=");
+    if (since_pos != std::string_view::npos) {
+        AgentMetrics::instance().count_request(AgentMetrics::ROUTE_STATUS_DELTA);
+        uint64_t since = strtoull(ctx.query.data() + since_pos + 6, nullptr, 10);
+        return handle_status_delta_request(json, since);
+    }
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_STATUS);
+    return handle_status_request(json);
+}
+
+int HttpServer::route_metrics(const RouteContext& ctx, JsonWriter& json) {
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_METRICS);
+    *ctx.content_type = "text/plain; version=0.0.4";
+    return handle_metrics_request(json);
+}
+
+int HttpServer::route_logs(const RouteContext& ctx, JsonWriter& json) {
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_LOGS);
+    *ctx.content_type = "text/plain";
+    pid_t pid = 0;
+    for (char c : ctx.path_tail) {
+        if (c < '0' || c > '9') {
+            *ctx.content_type = "application/json";
+            return write_error_body(json, "Invalid pid", 400);
+        }
+        pid = pid * 10 + (c - '0');
+    }
+    if (ctx.path_tail.empty()) {
+        *ctx.content_type = "application/json";
+        return write_error_body(json, "Invalid pid", 400);
+    }
+    return handle_logs_request(pid, ctx.query, json, *ctx.file_fd, *ctx.file_size);
+}
+
+int HttpServer::route_start(const RouteContext& ctx, JsonWriter& json) {
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_START);
+    return handle_start_request(std::string(ctx.body), json);
+}
+
+int HttpServer::route_start_batch(const RouteContext& ctx, JsonWriter& json) {
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_START_BATCH);
+    return handle_start_batch_request(std::string(ctx.body), json);
 }
 
-std::string HttpServer::create_error_response(const std::string& error, int status_code) {
-    std::ostringstream json;
-    json << "{\"error\":\"" << error << "\"}";
-    return create_json_response(json.str(), status_code);
+int HttpServer::route_stop(const RouteContext& ctx, JsonWriter& json) {
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_STOP);
+    return handle_stop_request(std::string(ctx.body), json);
 }
 
-std::string HttpServer::handle_status_request() {
+int HttpServer::route_drain(const RouteContext& ctx, JsonWriter& json) {
+    (void)ctx;
+    AgentMetrics::instance().count_request(AgentMetrics::ROUTE_OTHER);
+    return handle_drain_request(json);
+}
+
+// Dispatch table, sorted by (method, segment) for the binary search in
+// route_request — keep it sorted when registering a new endpoint (the
+// startup check in start_server catches a misordered row). Prefix rows
+// match "segment/<tail>"; exact rows match the segment alone.
+const HttpServer::RouteEntry HttpServer::ROUTE_TABLE[] = {
+    {"GET",  "/logs",        true,  &HttpServer::route_logs},
+    {"GET",  "/metrics",     false, &HttpServer::route_metrics},
+    {"GET",  "/status",      false, &HttpServer::route_status},
+    {"POST", "/drain",       false, &HttpServer::route_drain},
+    {"POST", "/start",       false, &HttpServer::route_start},
+    {"POST", "/start_batch", false, &HttpServer::route_start_batch},
+    {"POST", "/stop",        false, &HttpServer::route_stop},
+};
+const size_t HttpServer::ROUTE_TABLE_SIZE =
+    sizeof(HttpServer::ROUTE_TABLE) / sizeof(HttpServer::ROUTE_TABLE[0]);
+
+int HttpServer::route_request(const HttpParser& parser, JsonWriter& json,
+                              const char*& content_type, int& file_fd,
+                              size_t& file_size, bool& stream_status) {
+    AgentMetrics& metrics = AgentMetrics::instance();
+    ScopedTimer timer(metrics.http_request_latency);
+
+    std::string_view method = parser.method();
+    std::string_view path = parser.path();
+
+    // Split off the query string
+    std::string_view query;
+    size_t question = path.find('?');
+    if (question != std::string_view::npos) {
+        query = path.substr(question + 1);
+        path = path.substr(0, question);
+    }
+
+    // Lookup key is the first path segment, so /logs/<pid> finds the
+    // /logs row and hands the pid through as the tail
+    size_t slash = path.find('/', 1);
+    std::string_view segment = (slash != std::string_view::npos)
+                                   ? path.substr(0, slash)
+                                   : path;
+
+    const RouteEntry* first = ROUTE_TABLE;
+    const RouteEntry* last = ROUTE_TABLE + ROUTE_TABLE_SIZE;
+    const RouteEntry* entry = std::lower_bound(
+        first, last, std::make_pair(method, segment),
+        [](const RouteEntry& row, const std::pair<std::string_view, std::string_view>& key) {
+            if (row.method != key.first) {
+                return row.method < key.first;
+            }
+            return row.segment < key.second;
+        });
+
+    if (entry == last || entry->method != method || entry->segment != segment ||
+        (!entry->prefix && slash != std::string_view::npos)) {
+        metrics.count_request(AgentMetrics::ROUTE_OTHER);
+        return write_error_body(json, "Not Found", 404);
+    }
+
+    RouteContext ctx;
+    ctx.path_tail = (slash != std::string_view::npos) ? path.substr(slash + 1)
+                                                      : std::string_view();
+    ctx.query = query;
+    ctx.body = parser.body();
+    ctx.content_type = &content_type;
+    ctx.file_fd = &file_fd;
+    ctx.file_size = &file_size;
+    ctx.stream_status = &stream_status;
+
+    return (this->*(entry->handler))(ctx, json);
+}
+
+int HttpServer::handle_metrics_request(JsonWriter& json) {
+    json.raw(AgentMetrics::instance().render());
+
+    char line[128];
+    snprintf(line, sizeof(line),
+             "# TYPE agent_log_dropped_total counter\n"
+             "agent_log_dropped_total %llu\n",
+             (unsigned long long)AsyncLog::instance().dropped());
+    json.raw(line);
+    return 200;
+}
+
+int HttpServer::handle_logs_request(pid_t pid, std::string_view query,
+                                    JsonWriter& json, int& file_fd,
+                                    size_t& file_size) {
+    // ?tail=N serves the last N bytes from the in-memory ring; the default
+    // streams the full spill file with sendfile, no user-space copy
+    size_t tail_pos = query.find("tail=");
+    if (tail_pos != std::string_view::npos) {
+        size_t max_bytes = strtoul(query.data() + tail_pos + 5, nullptr, 10);
+        std::string tail;
+        if (!agent.get_log_tail(pid, max_bytes, tail)) {
+            return write_error_body(json, "No logs for pid", 404);
+        }
+        json.raw(tail);
+        return 200;
+    }
+
+    int fd = agent.open_log_file(pid, file_size);
+    if (fd >= 0) {
+        file_fd = fd;
+        return 200;
+    }
+
+    // No spill file (creation failed at launch); fall back to the ring
+    std::string tail;
+    if (!agent.get_log_tail(pid, NodeAgent::LOG_RING_CAPACITY, tail)) {
+        return write_error_body(json, "No logs for pid", 404);
+    }
+    json.raw(tail);
+    return 200;
+}
+
+int HttpServer::write_error_body(JsonWriter& json, const char* error, int status_code) {
+    json.raw("{\"error\":\"");
+    json.raw(error);
+    json.raw("\"}");
+    return status_code;
+}
+
+int HttpServer::handle_status_request(JsonWriter& json) {
     SystemMetrics metrics = agent.get_system_metrics();
-    std::vector<ProcessInfo> processes = agent.get_running_processes();
-    
-    std::ostringstream json;
-    json << "{";
-    json << "\"cpu_usage\":" << metrics.cpu_usage << ",";
-    json << "\"memory_usage\":" << metrics.memory_usage << ",";
-    json << "\"total_memory\":" << metrics.total_memory << ",";
-    json << "\"available_memory\":" << metrics.available_memory << ",";
-    json << "\"running_processes\":" << processes.size() << ",";
-    json << "\"processes\":[";
-    
-    for (size_t i = 0; i < processes.size(); ++i) {
-        if (i > 0) json << ",";
-        json << "{";
-        json << "\"pid\":" << processes[i].pid << ",";
-        json << "\"command\":\"" << processes[i].command << "\",";
-        json << "\"start_time\":\"" << processes[i].start_time << "\",";
-        json << "\"status\":\"" << processes[i].status << "\"";
-        json << "}";
-    }
-    
-    json << "]}";
-    
-    return create_json_response(json.str());
-}
-
-std::string HttpServer::handle_start_request(const std::string& body) {
+
+    // Single pass into the connection's reusable buffer; no streams, and
+    // no intermediate copy of the table — entries are serialized straight
+    // from the shards via for_each_process
+    json.raw('{');
+    json.key("cpu_usage");
+    json.number(metrics.cpu_usage);
+    json.raw(',');
+    json.key("memory_usage");
+    json.number(metrics.memory_usage);
+    json.raw(',');
+    json.key("total_memory");
+    json.number((int64_t)metrics.total_memory);
+    json.raw(',');
+    json.key("available_memory");
+    json.number((int64_t)metrics.available_memory);
+    json.raw(',');
+    json.key("running_processes");
+    json.number((int64_t)agent.get_process_count());
+    json.raw(',');
+    // Launch backlog: a scheduler seeing this grow should back off
+    json.key("queue_depth");
+    json.number((int64_t)agent.get_launch_queue_depth());
+    json.raw(',');
+    json.key("draining");
+    json.raw(agent.is_draining() ? "true" : "false");
+    json.raw(',');
+    json.key("processes");
+    json.raw('[');
+
+    bool first = true;
+    agent.for_each_process([&](const ProcessInfo& info) {
+        if (!first) json.raw(',');
+        first = false;
+        write_process_json(json, info);
+    });
+
+    json.raw(']');
+    json.raw('}');
+
+    return 200;
+}
+
+bool HttpServer::fill_status_chunk(HttpConnection* conn) {
+    const int shard_count = (int)NodeAgent::TABLE_SHARD_COUNT;
+    if (conn->stream_shard > shard_count) {
+        return false; // terminating chunk already went out
+    }
+
+    // Per-thread scratch keeps its capacity, so refills stop allocating
+    // after the first large chunk
+    thread_local JsonWriter scratch;
+    scratch.clear();
+
+    if (conn->stream_shard == 0) {
+        // Same prelude as the buffered form
+        SystemMetrics metrics = agent.get_system_metrics();
+        scratch.raw('{');
+        scratch.key("cpu_usage");
+        scratch.number(metrics.cpu_usage);
+        scratch.raw(',');
+        scratch.key("memory_usage");
+        scratch.number(metrics.memory_usage);
+        scratch.raw(',');
+        scratch.key("total_memory");
+        scratch.number((int64_t)metrics.total_memory);
+        scratch.raw(',');
+        scratch.key("available_memory");
+        scratch.number((int64_t)metrics.available_memory);
+        scratch.raw(',');
+        scratch.key("running_processes");
+        scratch.number((int64_t)agent.get_process_count());
+        scratch.raw(',');
+        scratch.key("queue_depth");
+        scratch.number((int64_t)agent.get_launch_queue_depth());
+        scratch.raw(',');
+        scratch.key("draining");
+        scratch.raw(agent.is_draining() ? "true" : "false");
+        scratch.raw(',');
+        scratch.key("processes");
+        scratch.raw('[');
+    }
+
+    // One shard per lock acquisition; stop once the chunk target is hit
+    // so the buffer stays small no matter how big the table is
+    while (conn->stream_shard < shard_count && scratch.size() < STATUS_CHUNK_TARGET) {
+        agent.for_each_process_in_shard((size_t)conn->stream_shard,
+                                        [&](const ProcessInfo& info) {
+            if (!conn->stream_first) {
+                scratch.raw(',');
+            }
+            conn->stream_first = false;
+            write_process_json(scratch, info);
+        });
+        conn->stream_shard++;
+    }
+
+    bool done = (conn->stream_shard == shard_count);
+    if (done) {
+        scratch.raw("]}");
+        conn->stream_shard = shard_count + 1;
+    }
+
+    // Frame the payload as one HTTP chunk; the final refill appends the
+    // terminating zero-length chunk
+    conn->json.clear();
+    char frame[32];
+    snprintf(frame, sizeof(frame), "%zx\r\n", scratch.size());
+    conn->json.raw(frame);
+    conn->json.raw(scratch.str());
+    conn->json.raw("\r\n");
+    if (done) {
+        conn->json.raw("0\r\n\r\n");
+    }
+    return true;
+}
+
+int HttpServer::handle_status_delta_request(JsonWriter& json, uint64_t since) {
+    std::vector<ProcessInfo> changed;
+    std::vector<pid_t> removed;
+    bool full_snapshot = false;
+
+    uint64_t seq = agent.get_processes_since(since, changed, removed, full_snapshot);
+
+    json.raw('{');
+    json.key("seq");
+    json.number((int64_t)seq);
+    json.raw(',');
+    json.key("full");
+    json.raw(full_snapshot ? "true" : "false");
+    json.raw(',');
+    json.key("processes");
+    json.raw('[');
+    for (size_t i = 0; i < changed.size(); ++i) {
+        if (i > 0) json.raw(',');
+        write_process_json(json, changed[i]);
+    }
+    json.raw(']');
+    json.raw(',');
+    json.key("removed");
+    json.raw('[');
+    for (size_t i = 0; i < removed.size(); ++i) {
+        if (i > 0) json.raw(',');
+        json.number((int64_t)removed[i]);
+    }
+    json.raw(']');
+    json.raw('}');
+
+    return 200;
+}
+
+void HttpServer::write_process_json(JsonWriter& json, const ProcessInfo& info) {
+    json.raw('{');
+    json.key("pid");
+    json.number((int64_t)info.pid);
+    json.raw(',');
+    json.key("command");
+    json.quoted(info.command);
+    json.raw(',');
+    json.key("start_time");
+    json.quoted(info.start_time);
+    json.raw(',');
+    json.key("status");
+    json.quoted(info.status);
+    json.raw(',');
+    json.key("cpu_percent");
+    json.number(info.cpu_percent);
+    json.raw(',');
+    json.key("rss_kb");
+    json.number((int64_t)info.rss_kb);
+    json.raw('}');
+}
+
+int HttpServer::handle_drain_request(JsonWriter& json) {
+    // Stop admitting new workloads and open the handoff socket so the
+    // replacement binary can take over the listeners (see handoff.h).
+    // Idempotent: a repeated /drain reports the same socket path.
+    agent.begin_drain();
+
+    std::string socket_path = drain_callback ? drain_callback() : "";
+    if (socket_path.empty()) {
+        return write_error_body(json, "Failed to open handoff socket", 500);
+    }
+
+    json.raw("{\"status\":\"draining\",\"handoff_socket\":\"");
+    json.raw(socket_path.c_str());
+    json.raw("\"}");
+    return 200;
+}
+
+int HttpServer::handle_start_request(const std::string& body, JsonWriter& json) {
+    if (agent.is_draining()) {
+        return write_error_body(json, "Agent is draining", 503);
+    }
+
     std::string script_path = parse_json_field(body, "script_path");
     if (script_path.empty()) {
-        return create_error_response("Missing script_path field", 400);
+        return write_error_body(json, "Missing script_path field", 400);
+    }
+
+    // Optional args array, same shape as /start_batch entries
+    LaunchRequest request;
+    request.script_path = script_path;
+    request.args = parse_json_string_array(body, "args");
+
+    // Optional cgroup v2 limits, written verbatim to cpu.max / memory.max
+    request.cpu_max = parse_json_field(body, "cpu_max");
+    request.memory_max = parse_json_field(body, "memory_max");
+
+    // Admission control: the workload is queued, not forked inline; the
+    // dispatcher launches it at the node's configured rate and the pid
+    // appears in /status once it runs
+    std::vector<uint64_t> queued_ids = agent.enqueue_launches({request});
+    if (queued_ids.empty()) {
+        return write_error_body(json, "Launch queue full", 503);
+    }
+
+    json.raw("{\"queued_id\":");
+    json.number((int64_t)queued_ids[0]);
+    json.raw(",\"status\":\"queued\"}");
+    return 200;
+}
+
+int HttpServer::handle_start_batch_request(const std::string& body, JsonWriter& json) {
+    if (agent.is_draining()) {
+        return write_error_body(json, "Agent is draining", 503);
     }
-    
-    pid_t pid = agent.start_process(script_path);
-    if (pid > 0) {
-        std::ostringstream json;
-        json << "{\"pid\":" << pid << ",\"status\":\"started\"}";
-        return create_json_response(json.str());
-    } else {
-        return create_error_response("Failed to start process", 500);
+
+    // Expected body: {"workloads":[{"script_path":"...","args":["..."]}, ...]}
+    std::vector<std::string> entries = parse_json_objects(body, "workloads");
+    if (entries.empty()) {
+        return write_error_body(json, "Missing or empty workloads array", 400);
     }
+
+    std::vector<LaunchRequest> batch;
+    batch.reserve(entries.size());
+
+    for (const auto& entry : entries) {
+        LaunchRequest request;
+        request.script_path = parse_json_field(entry, "script_path");
+        if (request.script_path.empty()) {
+            return write_error_body(json, "Missing script_path in workloads entry", 400);
+        }
+        request.args = parse_json_string_array(entry, "args");
+        request.cpu_max = parse_json_field(entry, "cpu_max");
+        request.memory_max = parse_json_field(entry, "memory_max");
+        batch.push_back(request);
+    }
+
+    // All-or-nothing admission, same contract as single /start
+    std::vector<uint64_t> queued_ids = agent.enqueue_launches(batch);
+    if (queued_ids.empty()) {
+        return write_error_body(json, "Launch queue full", 503);
+    }
+
+    json.raw("{\"results\":[");
+    for (size_t i = 0; i < queued_ids.size(); ++i) {
+        if (i > 0) json.raw(',');
+        json.raw("{\"queued_id\":");
+        json.number((int64_t)queued_ids[i]);
+        json.raw(",\"status\":\"queued\"}");
+    }
+    json.raw("]}");
+
+    return 200;
 }
 
-std::string HttpServer::handle_stop_request(const std::string& body) {
+int HttpServer::handle_stop_request(const std::string& body, JsonWriter& json) {
     std::string pid_str = parse_json_field(body, "pid");
     if (pid_str.empty()) {
-        return create_error_response("Missing pid field", 400);
+        return write_error_body(json, "Missing pid field", 400);
     }
-    
+
     try {
         pid_t pid = std::stoi(pid_str);
         if (agent.stop_process(pid)) {
-            std::ostringstream json;
-            json << "{\"status\":\"stopped\"}";
-            return create_json_response(json.str());
+            json.raw("{\"status\":\"stopped\"}");
+            return 200;
         } else {
-            return create_error_response("Failed to stop process", 500);
+            return write_error_body(json, "Failed to stop process", 500);
         }
     } catch (const std::exception& e) {
-        return create_error_response("Invalid PID format", 400);
+        return write_error_body(json, "Invalid PID format", 400);
     }
 }
 
+std::vector<std::string> HttpServer::parse_json_objects(const std::string& json, const std::string& field) {
+    // Extract the top-level objects of the named array by brace counting.
+    // Good enough for our flat request bodies; we don't nest objects.
+    std::vector<std::string> objects;
+
+    std::string pattern = "\"" + field + "\":";
+    size_t pos = json.find(pattern);
+    if (pos == std::string::npos) {
+        return objects;
+    }
+
+    size_t array_start = json.find('[', pos + pattern.length());
+    if (array_start == std::string::npos) {
+        return objects;
+    }
+
+    int depth = 0;
+    size_t object_start = 0;
+    for (size_t i = array_start + 1; i < json.length(); ++i) {
+        char c = json[i];
+        if (c == '{') {
+            if (depth == 0) {
+                object_start = i;
+            }
+            depth++;
+        } else if (c == '}') {
+            depth--;
+            if (depth == 0) {
+                objects.push_back(json.substr(object_start, i - object_start + 1));
+            }
+        } else if (c == ']' && depth == 0) {
+            break;
+        }
+    }
+
+    return objects;
+}
+
+std::vector<std::string> HttpServer::parse_json_string_array(const std::string& json, const std::string& field) {
+    std::vector<std::string> values;
+
+    std::string pattern = "\"" + field + "\":";
+    size_t pos = json.find(pattern);
+    if (pos == std::string::npos) {
+        return values;
+    }
+
+    size_t array_start = json.find('[', pos + pattern.length());
+    if (array_start == std::string::npos) {
+        return values;
+    }
+
+    size_t i = array_start + 1;
+    while (i < json.length() && json[i] != ']') {
+        if (json[i] == '"') {
+            size_t end = json.find('"', i + 1);
+            if (end == std::string::npos) {
+                break;
+            }
+            values.push_back(json.substr(i + 1, end - i - 1));
+            i = end + 1;
+        } else {
+            ++i;
+        }
+    }
+
+    return values;
+}
+
 std::string HttpServer::parse_json_field(const std::string& json, const std::string& field) {
     std::string pattern = "\"" + field + "\":";
     size_t pos = json.find(pattern);
     if (pos == std::string::npos) {
         return "";
     }
-    
+
     pos += pattern.length();
-    
+
     // Skip whitespace
     while (pos < json.length() && (json[pos] == ' ' || json[pos] == '\t')) {
         pos++;
     }
-    
+
     if (pos >= json.length()) {
         return "";
     }
-    
+
     // Handle string values
     if (json[pos] == '"') {
         pos++; // Skip opening quote
@@ -281,13 +1160,13 @@ std::string HttpServer::parse_json_field(const std::string& json, const std::str
         }
         return json.substr(pos, end_pos - pos);
     }
-    
+
     // Handle numeric values
     size_t end_pos = pos;
-    while (end_pos < json.length() && 
+    while (end_pos < json.length() &&
            (std::isdigit(json[end_pos]) || json[end_pos] == '.' || json[end_pos] == '-')) {
         end_pos++;
     }
-    
+
     return json.substr(pos, end_pos - pos);
-} 
\ No newline at end of file
+}
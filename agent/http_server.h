@@ -2,43 +2,220 @@
 #define HTTP_SERVER_H
 
 #include "node_agent.h"
+#include "json_writer.h"
+#include "http_parser.h"
 #include <string>
-#include <map>
 #include <functional>
+#include <vector>
+
+// Per-connection state for the event loop.
+// A response is transmitted as two iovecs — headers formatted into the
+// fixed header array, body referenced in place from the serializer's
+// buffer — so the body is copied exactly once, user to kernel. While a
+// response is in flight the next pipelined request waits in read_buffer.
+struct HttpConnection {
+    int fd;
+    std::string read_buffer;
+
+    char response_header[256];
+    size_t header_length;
+    size_t header_sent;
+    size_t body_sent;
+    bool response_in_flight;
+    bool epollout_armed;
+    bool close_after_flush;
+
+    // File-backed response tail (GET /logs). After the header and any JSON
+    // body drain, file_remaining bytes are pushed with sendfile — zero-copy,
+    // never staged in user space. -1 when the response is buffer-only.
+    int file_fd;
+    off_t file_offset;
+    size_t file_remaining;
+
+    // Streaming chunked /status (?stream=1). stream_shard is the next
+    // table shard to serialize (-1 when the response is not streamed);
+    // each refill re-fills json with one chunk, so peak memory per
+    // request stays a few KB no matter how large the table is.
+    // stream_first carries the record-separator state across refills.
+    int stream_shard;
+    bool stream_first;
+
+    // Reusable serialization buffer holding the current response body;
+    // keeps its capacity across keep-alive requests so large /status
+    // responses stop allocating after warmup
+    JsonWriter json;
+
+    // Incremental request parser; resumes where the last recv left off
+    HttpParser parser;
+
+    HttpConnection(int fd) : fd(fd), header_length(0), header_sent(0),
+                             body_sent(0), response_in_flight(false),
+                             epollout_armed(false), close_after_flush(false),
+                             file_fd(-1), file_offset(0), file_remaining(0),
+                             stream_shard(-1), stream_first(true) {}
+
+    // Prepare a recycled connection for a new socket; buffers keep their
+    // warmed-up capacity so the next request parses without allocating
+    void reset(int new_fd) {
+        fd = new_fd;
+        read_buffer.clear();
+        header_length = 0;
+        header_sent = 0;
+        body_sent = 0;
+        response_in_flight = false;
+        epollout_armed = false;
+        close_after_flush = false;
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        file_fd = -1;
+        file_offset = 0;
+        file_remaining = 0;
+        stream_shard = -1;
+        stream_first = true;
+        parser.reset();
+    }
+};
 
 class HttpServer {
 private:
     NodeAgent& agent;
-    int server_socket;
     int port;
     std::atomic<bool> running;
-    std::map<std::string, std::function<std::string(const std::string&)>> routes;
+
+    // Dispatch context handed to route adapters: the path remainder after
+    // a prefix route's registered segment, the query string, the request
+    // body, and the response out-parameters route_request owns.
+    struct RouteContext {
+        std::string_view path_tail;
+        std::string_view query;
+        std::string_view body;
+        const char** content_type;
+        int* file_fd;
+        size_t* file_size;
+        bool* stream_status;
+    };
+
+    // One row of the static dispatch table (see ROUTE_TABLE in the .cpp):
+    // method plus first path segment, matched exactly or — for prefix
+    // routes like /logs/<pid> — with the tail passed through the context.
+    // Plain member-function pointers: no std::function, no allocation,
+    // and lookup is a binary search over a sorted array.
+    struct RouteEntry {
+        std::string_view method;
+        std::string_view segment;
+        bool prefix;
+        int (HttpServer::*handler)(const RouteContext& ctx, JsonWriter& json);
+    };
+
+    // Route adapters: uniform signature over the handlers below, so they
+    // fit the dispatch table. Each counts its own request metric.
+    int route_status(const RouteContext& ctx, JsonWriter& json);
+    int route_metrics(const RouteContext& ctx, JsonWriter& json);
+    int route_logs(const RouteContext& ctx, JsonWriter& json);
+    int route_start(const RouteContext& ctx, JsonWriter& json);
+    int route_start_batch(const RouteContext& ctx, JsonWriter& json);
+    int route_stop(const RouteContext& ctx, JsonWriter& json);
+    int route_drain(const RouteContext& ctx, JsonWriter& json);
+
+    static const RouteEntry ROUTE_TABLE[];
+    static const size_t ROUTE_TABLE_SIZE;
+
+    // Event loop threads, one epoll instance each. Every loop owns its own
+    // SO_REUSEPORT listening socket and is pinned to a core, so the kernel
+    // load-balances incoming connections across the loops and accepts scale
+    // with cores instead of serializing on one socket's accept queue.
+    // Backlog defaults to 512, overridable via NODE_AGENT_LISTEN_BACKLOG.
+    static const int EVENT_LOOP_THREADS = 4;
+    std::vector<std::thread> event_loop_threads;
+    std::vector<int> listen_sockets;
+
+    // Drain-and-handoff support (see handoff.h). Listeners adopted from a
+    // draining predecessor are used in place of fresh sockets; each loop
+    // records its epoll fd so stop_accepting/resume_accepting can detach
+    // and re-attach the listeners from outside the loop threads.
+    std::vector<int> adopted_listeners;
+    std::vector<int> loop_epoll_fds;
+    std::function<std::string()> drain_callback;
+
+    // Free list of recycled HttpConnection objects. Keep-alive traffic
+    // reuses buffers within a connection; the pool extends that across
+    // connections, so steady-state accepts don't touch the allocator.
+    // Oversized buffers are released before pooling, which bounds retained
+    // memory at MAX_POOLED_CONNECTIONS * POOLED_BUFFER_LIMIT per buffer.
+    std::vector<HttpConnection*> connection_pool;
+    std::mutex pool_mutex;
+    static constexpr size_t MAX_POOLED_CONNECTIONS = 256;
+    static constexpr size_t POOLED_BUFFER_LIMIT = 64 * 1024;
+
+    HttpConnection* acquire_connection(int fd);
+    void release_connection(HttpConnection* conn);
+
+    void event_loop(int loop_index);
+    void accept_connections(int epoll_fd, int listen_socket);
+    bool handle_readable(int epoll_fd, HttpConnection* conn);
+    bool handle_writable(int epoll_fd, HttpConnection* conn);
+    void close_connection(int epoll_fd, HttpConnection* conn);
+    bool keep_alive_requested(const HttpParser& parser);
+    void write_process_json(JsonWriter& json, const ProcessInfo& info);
+
+    // Runs every complete request already buffered, transmitting each
+    // response before parsing the next; returns false to close
+    bool process_buffered_requests(int epoll_fd, HttpConnection* conn);
+
+    // Pushes the in-flight response (header + body iovecs) to the kernel
+    // with sendmsg; arms EPOLLOUT on a short write
+    bool flush_response(int epoll_fd, HttpConnection* conn);
+
+    // Refills conn->json with the next chunk of a streaming /status body,
+    // serializing shards until the chunk target is reached; returns false
+    // once the terminating chunk has already gone out
+    bool fill_status_chunk(HttpConnection* conn);
+    static constexpr size_t STATUS_CHUNK_TARGET = 16 * 1024;
 
 public:
     HttpServer(NodeAgent& agent, int port = 8080);
     ~HttpServer();
-    
+
     bool start_server();
     void stop_server();
     void run_server();
-    
-    // HTTP response helpers
-    std::string create_json_response(const std::string& data, int status_code = 200);
-    std::string create_error_response(const std::string& error, int status_code = 400);
-    
-    // Route handlers
-    std::string handle_status_request();
-    std::string handle_start_request(const std::string& body);
-    std::string handle_stop_request(const std::string& body);
-    
-    // HTTP parsing
-    std::map<std::string, std::string> parse_headers(const std::string& request);
+
+    // Route handlers write the response body into the serializer and
+    // return the HTTP status code
+    int handle_status_request(JsonWriter& json);
+    int handle_logs_request(pid_t pid, std::string_view query, JsonWriter& json,
+                            int& file_fd, size_t& file_size);
+    int handle_status_delta_request(JsonWriter& json, uint64_t since);
+    int handle_metrics_request(JsonWriter& json);
+    int handle_drain_request(JsonWriter& json);
+    int handle_start_request(const std::string& body, JsonWriter& json);
+    int handle_start_batch_request(const std::string& body, JsonWriter& json);
+    int handle_stop_request(const std::string& body, JsonWriter& json);
+    int write_error_body(JsonWriter& json, const char* error, int status_code);
+
+    // JSON body parsing
     std::string parse_json_field(const std::string& json, const std::string& field);
-    
-    // Client handling
-    void handle_client(int client_socket);
-    std::string read_request(int client_socket);
-    void send_response(int client_socket, const std::string& response);
+    std::vector<std::string> parse_json_objects(const std::string& json, const std::string& field);
+    std::vector<std::string> parse_json_string_array(const std::string& json, const std::string& field);
+
+    // Request routing: fills the body and content type, returns the status.
+    // A handler may instead hand back a file descriptor (plus its size) for
+    // the connection to stream with sendfile after the buffered body.
+    int route_request(const HttpParser& parser, JsonWriter& json,
+                      const char*& content_type, int& file_fd, size_t& file_size,
+                      bool& stream_status);
+
+    // Drain-and-handoff hooks (see handoff.h). adopt_listeners must be
+    // called before start_server; the callback, wired up by main, opens
+    // the handoff socket when /drain arrives and returns its path.
+    void adopt_listeners(std::vector<int> fds) { adopted_listeners = std::move(fds); }
+    void set_drain_callback(std::function<std::string()> callback) {
+        drain_callback = std::move(callback);
+    }
+    std::vector<int> listener_fds() const { return listen_sockets; }
+    void stop_accepting();
+    void resume_accepting();
 };
 
-#endif // HTTP_SERVER_H 
\ No newline at end of file
+#endif // HTTP_SERVER_H
@@ -0,0 +1,144 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Fixed-bucket latency histogram with power-of-two microsecond bounds
+// (1us, 2us, 4us, ... ~8.4s, +Inf). Recording is a clz plus two relaxed
+// atomic adds — a few nanoseconds — so instrumentation stays enabled in
+// production. Rendering may tear across buckets under concurrent updates;
+// scrape-grade accuracy is all we need.
+class LatencyHistogram
+{
+public:
+    static constexpr int BUCKETS = 24;  // last bucket is the +Inf overflow
+
+    void record_ns(uint64_t ns) {
+        uint64_t us = ns / 1000;
+        int idx = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+        if (idx >= BUCKETS) {
+            idx = BUCKETS - 1;
+        }
+        buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // Appends Prometheus histogram text (bucket/sum/count series) for the
+    // metric named `name` to `out`
+    void render(std::string& out, const char* name) const {
+        char line[160];
+        uint64_t cumulative = 0;
+        snprintf(line, sizeof(line), "# TYPE %s histogram\n", name);
+        out += line;
+        for (int i = 0; i < BUCKETS - 1; i++) {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            double bound_seconds = (double)(1ULL << i) / 1e6;
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%.6g\"} %llu\n",
+                     name, bound_seconds, (unsigned long long)cumulative);
+            out += line;
+        }
+        cumulative += buckets[BUCKETS - 1].load(std::memory_order_relaxed);
+        snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n",
+                 name, (unsigned long long)cumulative);
+        out += line;
+        snprintf(line, sizeof(line), "%s_sum %.9f\n", name,
+                 (double)total_ns.load(std::memory_order_relaxed) / 1e9);
+        out += line;
+        snprintf(line, sizeof(line), "%s_count %llu\n", name,
+                 (unsigned long long)cumulative);
+        out += line;
+    }
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS]{};
+    std::atomic<uint64_t> total_ns{0};
+};
+
+// RAII timer: records the scope's wall time into a histogram on exit
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.record_ns(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Process-wide instrumentation registry for the agent's own hot paths,
+// exported by GET /metrics in Prometheus text format
+struct AgentMetrics
+{
+    LatencyHistogram http_request_latency;
+    LatencyHistogram system_metrics_latency;
+    LatencyHistogram start_process_latency;
+    LatencyHistogram stop_process_latency;
+
+    std::atomic<uint64_t> connections_accepted{0};
+    std::atomic<uint64_t> launch_failures{0};
+
+    // Request counts by route; indexed by Route, rendered as a label
+    enum Route { ROUTE_STATUS = 0, ROUTE_STATUS_DELTA, ROUTE_START,
+                 ROUTE_START_BATCH, ROUTE_STOP, ROUTE_METRICS, ROUTE_LOGS,
+                 ROUTE_OTHER, ROUTE_COUNT };
+    std::atomic<uint64_t> requests_by_route[ROUTE_COUNT]{};
+
+    void count_request(Route route) {
+        requests_by_route[route].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static AgentMetrics& instance() {
+        static AgentMetrics metrics;
+        return metrics;
+    }
+
+    std::string render() const {
+        static const char* route_names[ROUTE_COUNT] = {
+            "status", "status_delta", "start", "start_batch",
+            "stop", "metrics", "logs", "other"
+        };
+
+        std::string out;
+        out.reserve(4096);
+        char line[160];
+
+        http_request_latency.render(out, "agent_http_request_duration_seconds");
+        system_metrics_latency.render(out, "agent_system_metrics_duration_seconds");
+        start_process_latency.render(out, "agent_start_process_duration_seconds");
+        stop_process_latency.render(out, "agent_stop_process_duration_seconds");
+
+        out += "# TYPE agent_http_requests_total counter\n";
+        for (int i = 0; i < ROUTE_COUNT; i++) {
+            snprintf(line, sizeof(line),
+                     "agent_http_requests_total{route=\"%s\"} %llu\n",
+                     route_names[i],
+                     (unsigned long long)requests_by_route[i].load(std::memory_order_relaxed));
+            out += line;
+        }
+
+        out += "# TYPE agent_connections_accepted_total counter\n";
+        snprintf(line, sizeof(line), "agent_connections_accepted_total %llu\n",
+                 (unsigned long long)connections_accepted.load(std::memory_order_relaxed));
+        out += line;
+
+        out += "# TYPE agent_launch_failures_total counter\n";
+        snprintf(line, sizeof(line), "agent_launch_failures_total %llu\n",
+                 (unsigned long long)launch_failures.load(std::memory_order_relaxed));
+        out += line;
+
+        return out;
+    }
+};
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,77 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <string>
+#include <charconv>
+#include <cstdint>
+
+// Serializes JSON directly into a reusable buffer. The buffer grows
+// geometrically (std::string) and keeps its capacity across clear(), so a
+// writer held per connection stops allocating after the first large
+// response. Numbers are formatted with std::to_chars, no streams involved.
+class JsonWriter {
+private:
+    std::string buffer;
+
+public:
+    JsonWriter() {
+        buffer.reserve(4096);
+    }
+
+    void clear() {
+        buffer.clear(); // capacity is retained
+    }
+
+    void raw(const char* text) {
+        buffer.append(text);
+    }
+
+    void raw(char c) {
+        buffer.push_back(c);
+    }
+
+    void raw(const std::string& text) {
+        buffer.append(text);
+    }
+
+    void number(int64_t value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr - digits);
+    }
+
+    void number(double value) {
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value,
+                                    std::chars_format::fixed, 2);
+        buffer.append(digits, result.ptr - digits);
+    }
+
+    void quoted(const std::string& value) {
+        buffer.push_back('"');
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                buffer.push_back('\\');
+            }
+            buffer.push_back(c);
+        }
+        buffer.push_back('"');
+    }
+
+    // Convenience for the common "key": prefix
+    void key(const char* name) {
+        buffer.push_back('"');
+        buffer.append(name);
+        buffer.append("\":");
+    }
+
+    const std::string& str() const {
+        return buffer;
+    }
+
+    size_t size() const {
+        return buffer.length();
+    }
+};
+
+#endif // JSON_WRITER_H
@@ -1,5 +1,8 @@
 #include "node_agent.h"
 #include "http_server.h"
+#include "binary_server.h"
+#include "control_channel.h"
+#include "handoff.h"
 #include <iostream>
 #include <signal.h>
 
@@ -36,25 +39,74 @@ int main(int argc, char* argv[]) {
     std::cout << "Starting Micro-Orchestrator Node Agent..." << std::endl;
     std::cout << "Port: " << port << std::endl;
     
+    // If a draining predecessor is waiting (rolling upgrade, see
+    // handoff.h), take over its listening sockets instead of binding
+    // fresh ones — connections already queued in the kernel are kept.
+    // This must happen before the NodeAgent recovers the process table:
+    // the predecessor flushes its admitted launch queue into the shared
+    // table file before answering, so recovery sees every promised pid.
+    std::vector<int> inherited_http;
+    int inherited_binary = -1;
+    bool adopted = handoff_receive(port, inherited_http, inherited_binary);
+    if (adopted) {
+        std::cout << "Taking over listeners from draining predecessor" << std::endl;
+    }
+
     // Create the Node Agent
     NodeAgent agent(port);
-    
+
     // Create and start the HTTP Server
     HttpServer http_server(agent, port);
-    
+
+    // Binary protocol listener for schedulers that opt out of HTTP
+    BinaryServer binary_server(agent, port + 1);
+
+    if (adopted) {
+        http_server.adopt_listeners(inherited_http);
+        if (inherited_binary >= 0) {
+            binary_server.adopt_listener(inherited_binary);
+        }
+    }
+
     if (!http_server.start_server()) {
         std::cerr << "Failed to start HTTP server" << std::endl;
         return 1;
     }
-    
+
+    // Start the event loop threads
+    http_server.run_server();
+
+    std::thread binary_thread;
+    if (binary_server.start_server()) {
+        binary_thread = std::thread(&BinaryServer::run_server, &binary_server);
+    } else {
+        std::cerr << "Failed to start binary protocol server" << std::endl;
+    }
+
+    // Outbound control channel for schedulers the agent must dial
+    // (enabled by NODE_AGENT_CONTROL_TARGET)
+    ControlChannel control_channel(agent, port);
+    control_channel.start();
+
+    // Drain-and-handoff coordinator; POST /drain arms it
+    HandoffServer handoff(agent, http_server, binary_server, port);
+    http_server.set_drain_callback([&handoff] { return handoff.begin(); });
+
     std::cout << "Node Agent is running. Press Ctrl+C to stop." << std::endl;
-    
-    // Run the HTTP server until shutdown is requested
-    while (!shutdown_requested) {
+
+    // Run the HTTP server until shutdown is requested or a successor
+    // agent has taken over the listeners
+    while (!shutdown_requested && !handoff.completed()) {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
-    
+
     std::cout << "Shutting down Node Agent..." << std::endl;
+    control_channel.stop();
+    handoff.stop();
+    binary_server.stop_server();
+    if (binary_thread.joinable()) {
+        binary_thread.join();
+    }
     http_server.stop_server();
     
     std::cout << "Node Agent stopped." << std::endl;
@@ -1,28 +1,325 @@
 #include "node_agent.h"
+#include "process_table.h"
+#include "instrumentation.h"
+#include "async_log.h"
+#include <cerrno>
 #include <chrono>
 #include <iomanip>
 #include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <dirent.h>
 
-NodeAgent::NodeAgent(int port) : port(port), running(false), prev_total_time(0), prev_idle_time(0) {
+extern char** environ;
+
+int NodeAgent::sigchld_pipe[2] = {-1, -1};
+
+void NodeAgent::sigchld_handler(int signum) {
+    (void)signum;
+    // Async-signal-safe: just nudge the worker thread
+    char byte = 1;
+    ssize_t written = write(sigchld_pipe[1], &byte, 1);
+    (void)written;
+}
+
+NodeAgent::NodeAgent(int port) : port(port), running(false), process_count(0),
+                                 change_sequence(0),
+                                 removal_log_trimmed_seq(0), prev_total_time(0), prev_idle_time(0),
+                                 active_snapshot(0), background_running(true), pending_kills(0),
+                                 last_process_sample_ms(0), next_queued_id(1),
+                                 draining(false) {
     server_socket = -1;
+
+    const char* engine = getenv("NODE_AGENT_LAUNCH_ENGINE");
+    use_posix_spawn = (engine == nullptr || strcmp(engine, "fork") != 0);
+
+    // Launch admission knobs (see launch_dispatcher_function)
+    const char* rate_env = getenv("NODE_AGENT_LAUNCH_RATE");
+    launch_rate_per_sec = (rate_env != nullptr) ? atoi(rate_env) : 0;
+    if (launch_rate_per_sec <= 0) {
+        launch_rate_per_sec = 50;
+    }
+    const char* ceiling_env = getenv("NODE_AGENT_MAX_PROCESSES");
+    int ceiling = (ceiling_env != nullptr) ? atoi(ceiling_env) : 0;
+    max_tracked_processes = (ceiling > 0) ? (size_t)ceiling : 512;
+
+    heartbeat_socket = -1;
+    setup_push_targets();
+
+    // Workload output capture lands under here, one file per pid
+    const char* log_dir_env = getenv("NODE_AGENT_LOG_DIR");
+    log_directory = (log_dir_env != nullptr && log_dir_env[0] != '\0')
+                        ? log_dir_env
+                        : "/tmp/node_agent_" + std::to_string(port) + "_logs";
+    if (mkdir(log_directory.c_str(), 0755) < 0 && errno != EEXIST) {
+        log_error("Error creating log directory: %s", log_directory.c_str());
+    }
+
+    setup_cgroup_root();
+
+    metrics_snapshots[0] = {};
+    metrics_snapshots[1] = {};
+
+    // Wire up SIGCHLD-driven reaping before any child can be forked
+    if (sigchld_pipe[0] < 0) {
+        if (pipe2(sigchld_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+            log_error("Error creating SIGCHLD pipe");
+        } else {
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = &NodeAgent::sigchld_handler;
+            sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+            sigaction(SIGCHLD, &sa, nullptr);
+        }
+    }
+
+    recover_process_table();
+
+    // Prime the snapshot so the first /status doesn't report zeros, then
+    // hand sampling off to the background worker
+    sample_system_metrics();
+    background_thread = std::thread(&NodeAgent::worker_thread_function, this);
+    dispatcher_thread = std::thread(&NodeAgent::launch_dispatcher_function, this);
 }
 
 NodeAgent::~NodeAgent() {
     stop_server();
+
+    background_running = false;
+    launch_queue_cv.notify_all();
+    if (dispatcher_thread.joinable()) {
+        dispatcher_thread.join();
+    }
+    if (background_thread.joinable()) {
+        background_thread.join();
+    }
+
+    if (heartbeat_socket >= 0) {
+        close(heartbeat_socket);
+        heartbeat_socket = -1;
+    }
+
+    std::lock_guard<std::mutex> lock(logs_mutex);
+    for (auto& pair : workload_logs) {
+        if (pair.second.pipe_fd >= 0) {
+            close(pair.second.pipe_fd);
+        }
+        if (pair.second.file_fd >= 0) {
+            close(pair.second.file_fd);
+        }
+    }
+    workload_logs.clear();
+}
+
+void NodeAgent::recover_process_table() {
+    const char* path_env = getenv("NODE_AGENT_TABLE_FILE");
+    std::string path = (path_env != nullptr && path_env[0] != '\0')
+                           ? path_env
+                           : "/tmp/node_agent_" + std::to_string(port) + ".table";
+
+    persistent_table.reset(new PersistentProcessTable());
+    if (!persistent_table->open(path)) {
+        // Degrade to in-memory-only tracking; every method becomes a no-op
+        return;
+    }
+
+    std::vector<ProcessInfo> survivors = persistent_table->recover();
+    if (survivors.empty()) {
+        return;
+    }
+
+    for (auto& info : survivors) {
+        // Re-attach to the survivor's cgroup leaf if the previous agent
+        // placed it in one (the table doesn't persist the path)
+        if (!cgroup_root.empty()) {
+            std::string leaf = cgroup_root + "/wl_" + std::to_string(info.pid);
+            struct stat leaf_stat;
+            if (stat(leaf.c_str(), &leaf_stat) == 0 && S_ISDIR(leaf_stat.st_mode)) {
+                info.cgroup_path = leaf;
+            }
+        }
+        TableShard& shard = shard_for(info.pid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        info.last_change_seq = change_sequence.fetch_add(1) + 1;
+        shard.entries[info.pid] = info;
+        process_count.fetch_add(1);
+    }
+    log_info("Recovered %zu tracked process(es) from %s",
+             survivors.size(), path.c_str());
+}
+
+void NodeAgent::setup_cgroup_root() {
+    // Opt-in: NODE_AGENT_CGROUP_ROOT names a cgroup v2 directory the agent
+    // may own (e.g. /sys/fs/cgroup/node_agent). Unset, or a root we can't
+    // create, leaves placement off and the /proc sampling path in charge.
+    const char* root = getenv("NODE_AGENT_CGROUP_ROOT");
+    if (root == nullptr || root[0] == '\0') {
+        return;
+    }
+
+    if (mkdir(root, 0755) < 0 && errno != EEXIST) {
+        log_error("Error creating cgroup root %s; per-workload limits disabled", root);
+        return;
+    }
+
+    cgroup_root = root;
+
+    // Delegate the cpu and memory controllers to the workload leaves.
+    // Failure (missing privileges, controllers not available) still allows
+    // placement and metrics, just not limit enforcement.
+    if (!write_cgroup_file(cgroup_root + "/cgroup.subtree_control", "+cpu +memory")) {
+        log_warn("could not enable cpu/memory controllers under %s; "
+                 "limits will not apply", cgroup_root.c_str());
+    }
+
+    // Sweep leaves left behind by a previous agent. rmdir only succeeds on
+    // empty cgroups, so leaves with surviving workloads (about to be
+    // recovered from the persistent table) are untouched.
+    DIR* dir = opendir(cgroup_root.c_str());
+    if (dir != nullptr) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (strncmp(entry->d_name, "wl_", 3) == 0) {
+                rmdir((cgroup_root + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+
+    log_info("Workload cgroups enabled under %s", cgroup_root.c_str());
+}
+
+bool NodeAgent::write_cgroup_file(const std::string& path, const char* value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t length = (ssize_t)strlen(value);
+    bool ok = write(fd, value, length) == length;
+    close(fd);
+    return ok;
+}
+
+std::string NodeAgent::create_workload_cgroup(pid_t pid, const LaunchRequest& request) {
+    if (cgroup_root.empty()) {
+        return "";
+    }
+
+    std::string path = cgroup_root + "/wl_" + std::to_string(pid);
+    if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST) {
+        log_error("Error creating cgroup for pid %d", pid);
+        return "";
+    }
+
+    if (!request.cpu_max.empty() &&
+        !write_cgroup_file(path + "/cpu.max", request.cpu_max.c_str())) {
+        log_error("Error applying cpu.max for pid %d", pid);
+    }
+    if (!request.memory_max.empty() &&
+        !write_cgroup_file(path + "/memory.max", request.memory_max.c_str())) {
+        log_error("Error applying memory.max for pid %d", pid);
+    }
+
+    // Move the child in. The brief window where it runs in our cgroup is
+    // unavoidable with posix_spawn; limits apply from this point on.
+    if (!write_cgroup_file(path + "/cgroup.procs",
+                           std::to_string(pid).c_str())) {
+        log_error("Error placing pid %d into %s", pid, path.c_str());
+        rmdir(path.c_str());
+        return "";
+    }
+
+    return path;
+}
+
+void NodeAgent::remove_workload_cgroup(const std::string& cgroup_path) {
+    if (cgroup_path.empty()) {
+        return;
+    }
+    // Kill any stragglers in the subtree, then drop the leaf. Best effort:
+    // if the kills are still in flight the rmdir fails and the empty leaf
+    // is swept up on the next agent start.
+    write_cgroup_file(cgroup_path + "/cgroup.kill", "1");
+    rmdir(cgroup_path.c_str());
+}
+
+void NodeAgent::setup_push_targets() {
+    const char* targets = getenv("NODE_AGENT_PUSH_TARGETS");
+    if (targets == nullptr || targets[0] == '\0') {
+        return;
+    }
+
+    for (const std::string& target : split_string(targets, ',')) {
+        size_t colon = target.rfind(':');
+        if (colon == std::string::npos) {
+            log_error("Ignoring malformed push target: %s", target.c_str());
+            continue;
+        }
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target.c_str() + colon + 1));
+        if (inet_pton(AF_INET, target.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+            log_error("Ignoring malformed push target: %s", target.c_str());
+            continue;
+        }
+
+        push_targets.push_back(addr);
+    }
+
+    if (!push_targets.empty()) {
+        heartbeat_socket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (heartbeat_socket < 0) {
+            log_error("Error creating heartbeat socket");
+            push_targets.clear();
+        } else {
+            log_info("Pushing heartbeats to %zu scheduler endpoint(s)",
+                     push_targets.size());
+        }
+    }
+}
+
+void NodeAgent::send_heartbeats() {
+    if (heartbeat_socket < 0) {
+        return;
+    }
+
+    HeartbeatPacket packet;
+    memset(&packet, 0, sizeof(packet));
+    gethostname(packet.node_id, sizeof(packet.node_id) - 1);
+    packet.agent_port = (uint16_t)port;
+
+    SystemMetrics metrics = get_system_metrics();
+    packet.cpu_usage = metrics.cpu_usage;
+    packet.memory_usage = metrics.memory_usage;
+    packet.total_memory = metrics.total_memory;
+    packet.available_memory = metrics.available_memory;
+    packet.running_processes = metrics.running_processes;
+
+    packet.change_seq = change_sequence.load();
+
+    for (const auto& target : push_targets) {
+        // Fire and forget; a lost datagram just means one missed heartbeat
+        sendto(heartbeat_socket, &packet, sizeof(packet), 0,
+               (const struct sockaddr*)&target, sizeof(target));
+    }
 }
 
 bool NodeAgent::start_server() {
     // Create socket
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    server_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (server_socket < 0) {
-        std::cerr << "Error creating socket" << std::endl;
+        log_error("Error creating socket");
         return false;
     }
     
     // Set socket options
     int opt = 1;
     if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "Error setting socket options" << std::endl;
+        log_error("Error setting socket options");
         return false;
     }
     
@@ -33,18 +330,23 @@ bool NodeAgent::start_server() {
     server_addr.sin_port = htons(port);
     
     if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        std::cerr << "Error binding socket" << std::endl;
+        log_error("Error binding socket");
         return false;
     }
     
-    // Listen for connections
-    if (listen(server_socket, 10) < 0) {
-        std::cerr << "Error listening on socket" << std::endl;
+    // Listen for connections, sharing the HTTP listeners' backlog knob
+    const char* backlog_env = getenv("NODE_AGENT_LISTEN_BACKLOG");
+    int backlog = (backlog_env != nullptr) ? atoi(backlog_env) : 0;
+    if (backlog <= 0) {
+        backlog = 512;
+    }
+    if (listen(server_socket, backlog) < 0) {
+        log_error("Error listening on socket");
         return false;
     }
     
     running = true;
-    std::cout << "Node Agent started on port " << port << std::endl;
+    log_info("Node Agent started on port %d", port);
     return true;
 }
 
@@ -54,207 +356,753 @@ void NodeAgent::stop_server() {
         close(server_socket);
         server_socket = -1;
     }
-    
-    // Wait for worker threads to finish
+
+    // Wake and join the worker pool
+    queue_cv.notify_all();
     for (auto& thread : worker_threads) {
         if (thread.joinable()) {
             thread.join();
         }
     }
     worker_threads.clear();
+
+    // Drop anything still queued
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    for (int client_socket : client_queue) {
+        close(client_socket);
+    }
+    client_queue.clear();
 }
 
 void NodeAgent::run_server() {
-    // Start worker threads
+    // Start the fixed worker pool
     for (int i = 0; i < MAX_THREADS; ++i) {
-        worker_threads.emplace_back(&NodeAgent::worker_thread_function, this);
+        worker_threads.emplace_back(&NodeAgent::client_worker_function, this);
     }
-    
+
     while (running) {
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
-        
+
         int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
         if (client_socket < 0) {
             if (running) {
-                std::cerr << "Error accepting connection" << std::endl;
+                log_error("Error accepting connection");
             }
             continue;
         }
-        
-        // Handle client in a separate thread
-        std::thread client_thread(&NodeAgent::handle_client, this, client_socket);
-        client_thread.detach();
+
+        // Hand the socket to the pool; refuse outright when saturated so a
+        // connection storm can't grow threads or memory
+        bool accepted = false;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (client_queue.size() < MAX_QUEUED_CLIENTS) {
+                client_queue.push_back(client_socket);
+                accepted = true;
+            }
+        }
+
+        if (accepted) {
+            queue_cv.notify_one();
+        } else {
+            close(client_socket);
+        }
+    }
+}
+
+void NodeAgent::client_worker_function() {
+    while (running) {
+        int client_socket = -1;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return !client_queue.empty() || !running; });
+            if (!running) {
+                break;
+            }
+            client_socket = client_queue.front();
+            client_queue.pop_front();
+        }
+
+        handle_client(client_socket);
     }
 }
 
 void NodeAgent::handle_client(int client_socket) {
     char buffer[1024];
+    // Reused across commands on this connection; after warmup its capacity
+    // is stable and command handling allocates nothing
+    std::string response;
+
     while (running) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-        
+        int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
+
         if (bytes_received <= 0) {
             break;
         }
-        
-        std::string command(buffer);
-        std::string response = handle_command(command);
-        
-        send(client_socket, response.c_str(), response.length(), 0);
+
+        response.clear();
+        handle_command(std::string_view(buffer, bytes_received), response);
+
+        send(client_socket, response.data(), response.length(), MSG_NOSIGNAL);
     }
-    
+
     close(client_socket);
 }
 
 void NodeAgent::worker_thread_function() {
-    // Worker threads are used for background tasks like metrics collection
-    while (running) {
-        cleanup_zombie_processes();
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+    // Background loop: block on the SIGCHLD pipe so child exits are reaped
+    // immediately, refresh the metrics snapshot on its cadence, and age
+    // out finished table entries
+    auto last_sample = std::chrono::steady_clock::now() - std::chrono::hours(1);
+    auto last_purge = std::chrono::steady_clock::now();
+
+    std::vector<struct pollfd> pfds;
+    while (background_running) {
+        pfds.clear();
+        pfds.push_back({sigchld_pipe[0], POLLIN, 0});
+        {
+            // Watch every live capture pipe so workload output is drained
+            // as it arrives instead of on the sampler cadence
+            std::lock_guard<std::mutex> lock(logs_mutex);
+            for (const auto& pair : workload_logs) {
+                if (pair.second.pipe_fd >= 0) {
+                    pfds.push_back({pair.second.pipe_fd, POLLIN, 0});
+                }
+            }
+        }
+
+        // Poll tightly only while a SIGKILL escalation is pending
+        int timeout_ms = pending_kills.load() > 0 ? 50 : METRICS_SAMPLE_INTERVAL_MS;
+        int ready = poll(pfds.data(), pfds.size(), timeout_ms);
+        if (ready > 0 && (pfds[0].revents & POLLIN)) {
+            // Drain the pipe; one wakeup can cover several exits
+            char drain[64];
+            while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+            reap_exited_children();
+        }
+        if (ready > 0) {
+            for (size_t i = 1; i < pfds.size(); i++) {
+                if (pfds[i].revents != 0) {
+                    drain_workload_logs();
+                    break;
+                }
+            }
+        }
+
+        if (pending_kills.load() > 0) {
+            escalate_pending_kills();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_sample >= std::chrono::milliseconds(METRICS_SAMPLE_INTERVAL_MS)) {
+            sample_system_metrics();
+            sample_process_metrics();
+            send_heartbeats();
+            last_sample = now;
+        }
+        if (now - last_purge >= std::chrono::seconds(EXITED_ENTRY_RETENTION_SECONDS)) {
+            purge_exited_entries();
+            last_purge = now;
+        }
     }
 }
 
-std::string NodeAgent::handle_command(const std::string& command) {
-    std::vector<std::string> args = split_string(command, ' ');
-    if (args.empty()) {
-        return "ERROR: Empty command";
+// Pops the next whitespace-delimited token off `input` without copying;
+// both views stay backed by the caller's receive buffer
+static std::string_view next_token(std::string_view& input) {
+    size_t begin = input.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) {
+        input = std::string_view();
+        return input;
     }
-    
-    std::string cmd = args[0];
-    
+    size_t end = input.find_first_of(" \t\r\n", begin);
+    if (end == std::string_view::npos) {
+        end = input.length();
+    }
+    std::string_view token = input.substr(begin, end - begin);
+    input.remove_prefix(end);
+    return token;
+}
+
+static void append_number(std::string& out, long value) {
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%ld", value);
+    out.append(digits, length);
+}
+
+void NodeAgent::handle_command(std::string_view command, std::string& response) {
+    std::string_view cmd = next_token(command);
+    if (cmd.empty()) {
+        response += "ERROR: Empty command";
+        return;
+    }
+
     if (cmd == "START") {
-        return handle_start_command(args);
+        handle_start_command(next_token(command), response);
     } else if (cmd == "STOP") {
-        return handle_stop_command(args);
+        handle_stop_command(next_token(command), response);
     } else if (cmd == "STATUS") {
-        return handle_status_command();
+        handle_status_command(response);
     } else {
-        return "ERROR: Unknown command: " + cmd;
+        response += "ERROR: Unknown command: ";
+        response.append(cmd.data(), cmd.length());
     }
 }
 
-std::string NodeAgent::handle_start_command(const std::vector<std::string>& args) {
-    if (args.size() < 2) {
-        return "ERROR: START command requires script path";
+void NodeAgent::handle_start_command(std::string_view script_path, std::string& response) {
+    if (script_path.empty()) {
+        response += "ERROR: START command requires script path";
+        return;
     }
-    
-    std::string script_path = args[1];
-    pid_t pid = start_process(script_path);
-    
+
+    // The one copy here is dwarfed by the launch itself
+    pid_t pid = start_process(std::string(script_path));
+
     if (pid > 0) {
-        return "SUCCESS: Process started with PID " + std::to_string(pid);
+        response += "SUCCESS: Process started with PID ";
+        append_number(response, pid);
     } else {
-        return "ERROR: Failed to start process";
+        response += "ERROR: Failed to start process";
     }
 }
 
-std::string NodeAgent::handle_stop_command(const std::vector<std::string>& args) {
-    if (args.size() < 2) {
-        return "ERROR: STOP command requires PID";
+void NodeAgent::handle_stop_command(std::string_view pid_text, std::string& response) {
+    if (pid_text.empty()) {
+        response += "ERROR: STOP command requires PID";
+        return;
     }
-    
-    try {
-        pid_t pid = std::stoi(args[1]);
-        if (stop_process(pid)) {
-            return "SUCCESS: Process " + std::to_string(pid) + " stopped";
-        } else {
-            return "ERROR: Failed to stop process " + std::to_string(pid);
+
+    pid_t pid = 0;
+    for (char c : pid_text) {
+        if (c < '0' || c > '9') {
+            response += "ERROR: Invalid PID format";
+            return;
         }
-    } catch (const std::exception& e) {
-        return "ERROR: Invalid PID format";
+        pid = pid * 10 + (c - '0');
+    }
+
+    if (stop_process(pid)) {
+        response += "SUCCESS: Process ";
+        append_number(response, pid);
+        response += " stopped";
+    } else {
+        response += "ERROR: Failed to stop process ";
+        append_number(response, pid);
     }
 }
 
-std::string NodeAgent::handle_status_command() {
+void NodeAgent::handle_status_command(std::string& response) {
     SystemMetrics metrics = get_system_metrics();
-    std::vector<ProcessInfo> processes = get_running_processes();
-    
-    std::stringstream response;
-    response << "STATUS:\n";
-    response << "CPU Usage: " << std::fixed << std::setprecision(2) << metrics.cpu_usage << "%\n";
-    response << "Memory Usage: " << std::fixed << std::setprecision(2) << metrics.memory_usage << "%\n";
-    response << "Total Memory: " << metrics.total_memory << " KB\n";
-    response << "Available Memory: " << metrics.available_memory << " KB\n";
-    response << "Running Processes: " << processes.size() << "\n\n";
-    
-    response << "Processes:\n";
-    for (const auto& proc : processes) {
-        response << "PID: " << proc.pid << " | Command: " << proc.command 
-                << " | Started: " << proc.start_time << " | Status: " << proc.status << "\n";
+    char line[512];
+
+    // Format straight from the table, one shard lock at a time, instead of
+    // copying the entries out first
+    int length = snprintf(line, sizeof(line),
+                          "STATUS:\n"
+                          "CPU Usage: %.2f%%\n"
+                          "Memory Usage: %.2f%%\n"
+                          "Total Memory: %ld KB\n"
+                          "Available Memory: %ld KB\n"
+                          "Running Processes: %zu\n\n"
+                          "Processes:\n",
+                          metrics.cpu_usage, metrics.memory_usage,
+                          metrics.total_memory, metrics.available_memory,
+                          process_count.load());
+    response.append(line, length);
+
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& pair : shard.entries) {
+            const ProcessInfo& proc = pair.second;
+            length = snprintf(line, sizeof(line),
+                              "PID: %d | Command: %s | Started: %s | Status: %s\n",
+                              proc.pid, proc.command.c_str(), proc.start_time.c_str(),
+                              proc.status.c_str());
+            response.append(line, std::min(length, (int)sizeof(line) - 1));
+        }
     }
-    
-    return response.str();
 }
 
 pid_t NodeAgent::start_process(const std::string& script_path) {
-    pid_t pid = fork();
-    
-    if (pid == 0) {
-        // Child process
-        execlp(script_path.c_str(), script_path.c_str(), nullptr);
-        exit(1); // Only reached if exec fails
-    } else if (pid > 0) {
+    LaunchRequest request;
+    request.script_path = script_path;
+    return launch_process(request);
+}
+
+std::vector<LaunchResult> NodeAgent::start_process_batch(const std::vector<LaunchRequest>& batch) {
+    std::vector<LaunchResult> results;
+    results.reserve(batch.size());
+
+    for (const auto& request : batch) {
+        pid_t pid = launch_process(request);
+        results.push_back({pid, pid > 0});
+    }
+
+    return results;
+}
+
+std::vector<uint64_t> NodeAgent::enqueue_launches(const std::vector<LaunchRequest>& batch) {
+    std::vector<uint64_t> queued_ids;
+
+    if (draining) {
+        return queued_ids; // the HTTP layer reports the drain distinctly
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(launch_queue_mutex);
+        // All-or-nothing: a partially admitted batch would leave the
+        // caller guessing which entries will run
+        if (launch_queue.size() + batch.size() > MAX_QUEUED_LAUNCHES) {
+            return queued_ids;
+        }
+
+        queued_ids.reserve(batch.size());
+        for (const auto& request : batch) {
+            uint64_t queued_id = next_queued_id.fetch_add(1);
+            launch_queue.push_back({queued_id, request});
+            queued_ids.push_back(queued_id);
+        }
+    }
+
+    launch_queue_cv.notify_one();
+    return queued_ids;
+}
+
+size_t NodeAgent::get_launch_queue_depth() const {
+    std::lock_guard<std::mutex> lock(launch_queue_mutex);
+    return launch_queue.size();
+}
+
+void NodeAgent::launch_dispatcher_function() {
+    // Token bucket: tokens accrue at launch_rate_per_sec and cap at one
+    // second's worth, so a burst drains smoothly instead of forking the
+    // whole backlog at once. Dispatch additionally pauses while the node
+    // is at its concurrency ceiling or the cached CPU sample is pegged —
+    // the queue absorbs the overload and /status reports its depth so the
+    // scheduler can back off.
+    double tokens = 0.0;
+    auto last_tick = std::chrono::steady_clock::now();
+
+    while (background_running) {
+        {
+            std::unique_lock<std::mutex> lock(launch_queue_mutex);
+            if (launch_queue.empty()) {
+                launch_queue_cv.wait(lock, [this] {
+                    return !launch_queue.empty() || !background_running;
+                });
+                if (!background_running) {
+                    break;
+                }
+                // Idle periods shouldn't bank a burst allowance
+                tokens = 0.0;
+                last_tick = std::chrono::steady_clock::now();
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(DISPATCH_TICK_MS));
+
+        auto now = std::chrono::steady_clock::now();
+        tokens += launch_rate_per_sec *
+                  std::chrono::duration<double>(now - last_tick).count();
+        last_tick = now;
+        if (tokens > (double)launch_rate_per_sec) {
+            tokens = (double)launch_rate_per_sec;
+        }
+
+        if (tokens < 1.0) {
+            continue;
+        }
+
+        // Admission gate against the cached snapshot — no extra sampling
+        // cost on this path
+        size_t tracked = process_count.load();
+        if (tracked >= max_tracked_processes) {
+            continue;
+        }
+        SystemMetrics metrics = get_system_metrics();
+        if (metrics.cpu_usage >= ADMISSION_CPU_PERCENT) {
+            continue;
+        }
+
+        size_t allowance = (size_t)tokens;
+        if (tracked + allowance > max_tracked_processes) {
+            allowance = max_tracked_processes - tracked;
+        }
+
+        std::vector<LaunchRequest> ready;
+        {
+            std::lock_guard<std::mutex> lock(launch_queue_mutex);
+            while (!launch_queue.empty() && ready.size() < allowance) {
+                ready.push_back(std::move(launch_queue.front().request));
+                launch_queue.pop_front();
+            }
+        }
+
+        if (!ready.empty()) {
+            tokens -= (double)ready.size();
+            start_process_batch(ready);
+        }
+    }
+}
+
+pid_t NodeAgent::launch_process(const LaunchRequest& request) {
+    ScopedTimer timer(AgentMetrics::instance().start_process_latency);
+    const std::string& script_path = request.script_path;
+
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(script_path.c_str()));
+    for (const auto& arg : request.args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+
+    // Capture pipe: the child's stdout/stderr both go to the write end,
+    // the worker drains the read end into the workload's log buffers.
+    // CLOEXEC on the write end is fine — dup2 onto 1/2 clears it.
+    int log_pipe[2] = {-1, -1};
+    if (pipe2(log_pipe, O_CLOEXEC) < 0) {
+        log_error("Error creating log capture pipe");
+    } else {
+        fcntl(log_pipe[0], F_SETFL, O_NONBLOCK);
+    }
+
+    if (use_posix_spawn) {
+        // posix_spawn avoids fork's page-table copy, so launch latency stays
+        // flat no matter how large the agent's heap gets. Each workload is
+        // placed in its own process group.
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setpgroup(&attr, 0);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_init(&file_actions);
+        if (log_pipe[1] >= 0) {
+            posix_spawn_file_actions_adddup2(&file_actions, log_pipe[1], STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&file_actions, log_pipe[1], STDERR_FILENO);
+        }
+
+        int rc = posix_spawnp(&pid, script_path.c_str(), &file_actions, &attr,
+                              argv.data(), environ);
+        posix_spawn_file_actions_destroy(&file_actions);
+        posix_spawnattr_destroy(&attr);
+        if (rc != 0) {
+            pid = -1;
+        }
+    } else {
+        pid = fork();
+        if (pid == 0) {
+            // Child process
+            setpgid(0, 0);
+            if (log_pipe[1] >= 0) {
+                dup2(log_pipe[1], STDOUT_FILENO);
+                dup2(log_pipe[1], STDERR_FILENO);
+            }
+            execvp(script_path.c_str(), argv.data());
+            _exit(1); // Only reached if exec fails
+        }
+    }
+
+    if (log_pipe[1] >= 0) {
+        close(log_pipe[1]);
+    }
+
+    if (pid > 0) {
+        if (log_pipe[0] >= 0) {
+            register_log_capture(pid, log_pipe[0]);
+        }
         // Parent process
-        std::lock_guard<std::mutex> lock(processes_mutex);
-        
         ProcessInfo info;
         info.pid = pid;
         info.command = script_path;
         info.start_time = get_current_time();
         info.status = "RUNNING";
-        
-        running_processes[pid] = info;
+        info.exit_code = 0;
+        info.exit_timestamp = 0;
+        info.kill_deadline_ms = 0;
+        info.cpu_percent = 0.0;
+        info.rss_kb = 0;
+        info.prev_cpu_ticks = 0;
+        info.cgroup_path = create_workload_cgroup(pid, request);
+
+        {
+            // The parked-exit check happens under the shard lock so it
+            // serializes against the reaper, which parks statuses for
+            // unknown pids while holding the same shard lock
+            TableShard& shard = shard_for(pid);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            {
+                std::lock_guard<std::mutex> parked_lock(unmatched_exits_mutex);
+                auto parked = unmatched_exits.find(pid);
+                if (parked != unmatched_exits.end()) {
+                    int status = parked->second;
+                    unmatched_exits.erase(parked);
+                    if (WIFEXITED(status)) {
+                        info.exit_code = WEXITSTATUS(status);
+                        info.status = "EXITED (" + std::to_string(info.exit_code) + ")";
+                    } else if (WIFSIGNALED(status)) {
+                        info.exit_code = 128 + WTERMSIG(status);
+                        info.status = "KILLED (signal " +
+                                      std::to_string(WTERMSIG(status)) + ")";
+                    }
+                    info.exit_timestamp = time(nullptr);
+                }
+            }
+            info.last_change_seq = change_sequence.fetch_add(1) + 1;
+            shard.entries[pid] = info;
+            process_count.fetch_add(1);
+        }
+        persistent_table->record_launch(info);
         return pid;
     } else {
         // Fork failed
+        if (log_pipe[0] >= 0) {
+            close(log_pipe[0]);
+        }
+        AgentMetrics::instance().launch_failures.fetch_add(1, std::memory_order_relaxed);
         return -1;
     }
 }
 
+void NodeAgent::register_log_capture(pid_t pid, int pipe_fd) {
+    WorkloadLog log;
+    log.pipe_fd = pipe_fd;
+    log.file_fd = -1;
+    log.total_written = 0;
+    log.file_bytes = 0;
+    log.ring.reserve(LOG_RING_CAPACITY);
+
+    log.file_path = log_directory + "/" + std::to_string(pid) + ".log";
+    log.file_fd = open(log.file_path.c_str(),
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log.file_fd < 0) {
+        // Ring-only capture still works; /logs just can't serve history
+        log.file_path.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(logs_mutex);
+    workload_logs[pid] = std::move(log);
+}
+
+void NodeAgent::drain_workload_logs() {
+    char buffer[4096];
+    std::lock_guard<std::mutex> lock(logs_mutex);
+
+    for (auto& pair : workload_logs) {
+        WorkloadLog& log = pair.second;
+        if (log.pipe_fd < 0) {
+            continue;
+        }
+
+        while (true) {
+            ssize_t bytes_read = read(log.pipe_fd, buffer, sizeof(buffer));
+            if (bytes_read > 0) {
+                // Spill first (capped), then roll the bytes into the ring
+                if (log.file_fd >= 0 && log.file_bytes < MAX_LOG_FILE_BYTES) {
+                    size_t to_spill = std::min((size_t)bytes_read,
+                                               MAX_LOG_FILE_BYTES - log.file_bytes);
+                    ssize_t written = write(log.file_fd, buffer, to_spill);
+                    if (written > 0) {
+                        log.file_bytes += written;
+                    }
+                }
+                for (ssize_t i = 0; i < bytes_read; ++i) {
+                    if (log.ring.size() < LOG_RING_CAPACITY) {
+                        log.ring.push_back(buffer[i]);
+                    } else {
+                        log.ring[log.total_written % LOG_RING_CAPACITY] = buffer[i];
+                    }
+                    log.total_written++;
+                }
+                continue;
+            }
+            if (bytes_read == 0) {
+                // Writer side fully closed; capture is complete
+                close(log.pipe_fd);
+                log.pipe_fd = -1;
+            }
+            break; // EAGAIN or EOF
+        }
+    }
+}
+
+void NodeAgent::remove_log_capture(pid_t pid) {
+    // The purge sweep calls this from the background worker while the
+    // dispatcher registers captures and /logs reads them; the map needs
+    // the same lock here (no path takes logs_mutex before a shard mutex,
+    // so the ordering is safe)
+    std::lock_guard<std::mutex> lock(logs_mutex);
+    auto it = workload_logs.find(pid);
+    if (it == workload_logs.end()) {
+        return;
+    }
+    if (it->second.pipe_fd >= 0) {
+        close(it->second.pipe_fd);
+    }
+    if (it->second.file_fd >= 0) {
+        close(it->second.file_fd);
+    }
+    if (!it->second.file_path.empty()) {
+        unlink(it->second.file_path.c_str());
+    }
+    workload_logs.erase(it);
+}
+
+bool NodeAgent::get_log_tail(pid_t pid, size_t max_bytes, std::string& out) {
+    std::lock_guard<std::mutex> lock(logs_mutex);
+
+    auto it = workload_logs.find(pid);
+    if (it == workload_logs.end()) {
+        return false;
+    }
+
+    const WorkloadLog& log = it->second;
+    size_t available = std::min(log.total_written, LOG_RING_CAPACITY);
+    size_t wanted = std::min(max_bytes, available);
+
+    // Oldest retained byte sits at total_written % capacity once the ring
+    // has wrapped; walk forward from (end - wanted)
+    size_t start = log.total_written - wanted;
+    for (size_t i = 0; i < wanted; ++i) {
+        out.push_back(log.ring[(start + i) % LOG_RING_CAPACITY]);
+    }
+    return true;
+}
+
+int NodeAgent::open_log_file(pid_t pid, size_t& size) {
+    std::lock_guard<std::mutex> lock(logs_mutex);
+
+    auto it = workload_logs.find(pid);
+    if (it == workload_logs.end() || it->second.file_path.empty()) {
+        return -1;
+    }
+
+    int fd = open(it->second.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    size = it->second.file_bytes;
+    return fd;
+}
+
 bool NodeAgent::stop_process(pid_t pid) {
-    std::lock_guard<std::mutex> lock(processes_mutex);
-    
-    auto it = running_processes.find(pid);
-    if (it == running_processes.end()) {
+    ScopedTimer timer(AgentMetrics::instance().stop_process_latency);
+    TableShard& shard = shard_for(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(pid);
+    if (it == shard.entries.end()) {
         return false;
     }
-    
-    // Send SIGTERM first
+
+    if (it->second.exit_timestamp != 0) {
+        // Already finished; nothing to stop
+        return false;
+    }
+
+    // Send SIGTERM and return immediately. The background worker escalates
+    // to SIGKILL if the process outlives the deadline, and the SIGCHLD path
+    // confirms the exit — no sleeping under the table lock.
     if (kill(pid, SIGTERM) == 0) {
-        // Wait a bit for graceful shutdown
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        
-        // Check if process is still running
-        if (kill(pid, 0) == 0) {
-            // Force kill with SIGKILL
-            kill(pid, SIGKILL);
+        if (it->second.kill_deadline_ms == 0) {
+            it->second.kill_deadline_ms = steady_now_ms() + KILL_ESCALATION_TIMEOUT_MS;
+            pending_kills.fetch_add(1);
         }
-        
-        running_processes.erase(it);
+        it->second.status = "STOPPING";
+        it->second.last_change_seq = ++change_sequence;
+        persistent_table->record_update(it->second);
         return true;
     }
-    
+
     return false;
 }
 
+void NodeAgent::escalate_pending_kills() {
+    // Force-kill anything that ignored SIGTERM past its deadline
+    int64_t now = steady_now_ms();
+
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& pair : shard.entries) {
+            ProcessInfo& info = pair.second;
+            if (info.kill_deadline_ms == 0 || info.exit_timestamp != 0) {
+                continue;
+            }
+            if (now >= info.kill_deadline_ms) {
+                kill(info.pid, SIGKILL);
+                // cgroup.kill takes the workload's whole subtree with it, so
+                // forked grandchildren can't outlive an escalated stop
+                if (!info.cgroup_path.empty()) {
+                    write_cgroup_file(info.cgroup_path + "/cgroup.kill", "1");
+                }
+                info.kill_deadline_ms = 0;
+                pending_kills.fetch_sub(1);
+            }
+        }
+    }
+}
+
+int64_t NodeAgent::steady_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
 std::vector<ProcessInfo> NodeAgent::get_running_processes() {
-    std::lock_guard<std::mutex> lock(processes_mutex);
     std::vector<ProcessInfo> result;
-    
-    for (const auto& pair : running_processes) {
-        result.push_back(pair.second);
+    result.reserve(process_count.load());
+
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& pair : shard.entries) {
+            result.push_back(pair.second);
+        }
     }
-    
+
     return result;
 }
 
+void NodeAgent::for_each_process(const std::function<void(const ProcessInfo&)>& fn) {
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& pair : shard.entries) {
+            fn(pair.second);
+        }
+    }
+}
+
+void NodeAgent::for_each_process_in_shard(size_t shard_index,
+                                          const std::function<void(const ProcessInfo&)>& fn) {
+    if (shard_index >= TABLE_SHARDS) {
+        return;
+    }
+    TableShard& shard = table_shards[shard_index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (const auto& pair : shard.entries) {
+        fn(pair.second);
+    }
+}
+
 SystemMetrics NodeAgent::get_system_metrics() {
-    SystemMetrics metrics;
+    ScopedTimer timer(AgentMetrics::instance().system_metrics_latency);
+    // Pure memory read: return the snapshot the sampler last published
+    return metrics_snapshots[active_snapshot.load(std::memory_order_acquire)];
+}
+
+void NodeAgent::sample_system_metrics() {
+    // Build the new snapshot in the inactive buffer, then flip. /proc/stat
+    // and /proc/meminfo are each read exactly once per sample.
+    int next = 1 - active_snapshot.load(std::memory_order_relaxed);
+    SystemMetrics& metrics = metrics_snapshots[next];
+
     metrics.cpu_usage = calculate_cpu_usage();
-    metrics.memory_usage = calculate_memory_usage();
-    
-    // Get memory info
+    metrics.total_memory = 0;
+    metrics.available_memory = 0;
+
     std::ifstream meminfo("/proc/meminfo");
     if (meminfo.is_open()) {
         std::string line;
@@ -266,11 +1114,179 @@ SystemMetrics NodeAgent::get_system_metrics() {
             }
         }
     }
-    
-    std::lock_guard<std::mutex> lock(processes_mutex);
-    metrics.running_processes = running_processes.size();
-    
-    return metrics;
+
+    if (metrics.total_memory > 0) {
+        metrics.memory_usage = 100.0 * (1.0 - (double)metrics.available_memory / metrics.total_memory);
+    } else {
+        metrics.memory_usage = 0.0;
+    }
+
+    metrics.running_processes = (int)process_count.load();
+
+    active_snapshot.store(next, std::memory_order_release);
+}
+
+void NodeAgent::sample_process_metrics() {
+    // One sweep over /proc/<pid>/stat for every tracked PID, reading each
+    // file with a single read() into a stack buffer. CPU% is derived from
+    // the utime+stime delta since the previous sweep, mirroring the
+    // prev_total_time logic used for the node-level figure.
+    int64_t now = steady_now_ms();
+    double elapsed_seconds = (last_process_sample_ms > 0)
+                                 ? (now - last_process_sample_ms) / 1000.0
+                                 : 0.0;
+    last_process_sample_ms = now;
+
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& pair : shard.entries) {
+            if (pair.second.exit_timestamp == 0) {
+                sample_one_process_locked(pair.second, elapsed_seconds);
+            }
+        }
+    }
+}
+
+void NodeAgent::sample_one_process_locked(ProcessInfo& info, double elapsed_seconds) {
+    static const long clock_ticks = sysconf(_SC_CLK_TCK);
+    static const long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    char path[64];
+    char buffer[1024];
+
+    // cgroup-placed workloads: two single-value files cover the whole
+    // subtree of children; fall through to /proc if the leaf vanished.
+    // The leaf outlives the process, so liveness still needs its own
+    // check (recovered orphans have no SIGCHLD to announce the exit).
+    if (!info.cgroup_path.empty()) {
+        if (kill(info.pid, 0) < 0 && errno == ESRCH) {
+            mark_exit_unknown_locked(info);
+            return;
+        }
+        if (read_cgroup_metrics(info, elapsed_seconds)) {
+            return;
+        }
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", info.pid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        // Entries recovered from the persistent table are not our
+        // children, so no SIGCHLD arrives when they exit — notice the
+        // disappearance here instead. Real exit status is unknowable.
+        if (kill(info.pid, 0) < 0 && errno == ESRCH) {
+            mark_exit_unknown_locked(info);
+        }
+        return;
+    }
+    ssize_t bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (bytes_read <= 0) {
+        return;
+    }
+    buffer[bytes_read] = '\0';
+
+    // The comm field can contain spaces; parse from the closing paren
+    char* p = strrchr(buffer, ')');
+    if (p == nullptr) {
+        return;
+    }
+    p += 2; // skip ") "
+
+    // A zombie we never get a SIGCHLD for (it was reparented while no
+    // agent was running) still has a /proc entry; treat it as exited
+    if (*p == 'Z') {
+        mark_exit_unknown_locked(info);
+        return;
+    }
+
+    // Fields after comm: state is 1, utime is 12, stime is 13, rss is 22
+    long utime = 0, stime = 0, rss_pages = 0;
+    int field = 1;
+    char* cursor = p;
+    while (*cursor != '\0' && field <= 22) {
+        if (field == 12) {
+            utime = strtol(cursor, &cursor, 10);
+        } else if (field == 13) {
+            stime = strtol(cursor, &cursor, 10);
+        } else if (field == 22) {
+            rss_pages = strtol(cursor, &cursor, 10);
+        } else {
+            while (*cursor != '\0' && *cursor != ' ') cursor++;
+        }
+        while (*cursor == ' ') cursor++;
+        field++;
+    }
+
+    long total_ticks = utime + stime;
+    if (info.prev_cpu_ticks > 0 && elapsed_seconds > 0 && clock_ticks > 0) {
+        long tick_delta = total_ticks - info.prev_cpu_ticks;
+        info.cpu_percent = 100.0 * ((double)tick_delta / clock_ticks) / elapsed_seconds;
+        if (info.cpu_percent < 0) {
+            info.cpu_percent = 0.0;
+        }
+    }
+    info.prev_cpu_ticks = total_ticks;
+    info.rss_kb = rss_pages * page_kb;
+}
+
+bool NodeAgent::read_cgroup_metrics(ProcessInfo& info, double elapsed_seconds) {
+    // cpu.stat's first line is "usage_usec <n>"; memory.current is a single
+    // number. Both are generated-on-read kernel files a few bytes long.
+    char buffer[256];
+
+    std::string stat_path = info.cgroup_path + "/cpu.stat";
+    int fd = open(stat_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (bytes_read <= 0) {
+        return false;
+    }
+    buffer[bytes_read] = '\0';
+
+    long usage_usec = 0;
+    if (sscanf(buffer, "usage_usec %ld", &usage_usec) != 1) {
+        return false;
+    }
+
+    if (info.prev_cpu_ticks > 0 && elapsed_seconds > 0) {
+        long usec_delta = usage_usec - info.prev_cpu_ticks;
+        info.cpu_percent = 100.0 * (usec_delta / 1e6) / elapsed_seconds;
+        if (info.cpu_percent < 0) {
+            info.cpu_percent = 0.0;
+        }
+    }
+    info.prev_cpu_ticks = usage_usec;
+
+    std::string memory_path = info.cgroup_path + "/memory.current";
+    fd = open(memory_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        bytes_read = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (bytes_read > 0) {
+            buffer[bytes_read] = '\0';
+            info.rss_kb = strtol(buffer, nullptr, 10) / 1024;
+        }
+    }
+
+    return true;
+}
+
+void NodeAgent::mark_exit_unknown_locked(ProcessInfo& info) {
+    // The process is gone but its real exit status is unobservable —
+    // it was never our child, or it exited while no agent was running
+    info.exit_code = -1;
+    info.status = "EXITED (unknown)";
+    info.exit_timestamp = time(nullptr);
+    info.last_change_seq = ++change_sequence;
+    persistent_table->record_update(info);
+    if (info.kill_deadline_ms != 0) {
+        info.kill_deadline_ms = 0;
+        pending_kills.fetch_sub(1);
+    }
 }
 
 double NodeAgent::calculate_cpu_usage() {
@@ -307,31 +1323,6 @@ double NodeAgent::calculate_cpu_usage() {
     return 0.0;
 }
 
-double NodeAgent::calculate_memory_usage() {
-    std::ifstream meminfo("/proc/meminfo");
-    if (!meminfo.is_open()) {
-        return 0.0;
-    }
-    
-    long total_memory = 0;
-    long available_memory = 0;
-    std::string line;
-    
-    while (std::getline(meminfo, line)) {
-        if (line.find("MemTotal:") == 0) {
-            sscanf(line.c_str(), "MemTotal: %ld", &total_memory);
-        } else if (line.find("MemAvailable:") == 0) {
-            sscanf(line.c_str(), "MemAvailable: %ld", &available_memory);
-        }
-    }
-    
-    if (total_memory > 0) {
-        return 100.0 * (1.0 - (double)available_memory / total_memory);
-    }
-    
-    return 0.0;
-}
-
 std::vector<std::string> NodeAgent::split_string(const std::string& str, char delimiter) {
     std::vector<std::string> tokens;
     std::stringstream ss(str);
@@ -354,19 +1345,109 @@ std::string NodeAgent::get_current_time() {
     return ss.str();
 }
 
-void NodeAgent::cleanup_zombie_processes() {
-    std::lock_guard<std::mutex> lock(processes_mutex);
-    
-    auto it = running_processes.begin();
-    while (it != running_processes.end()) {
-        pid_t pid = it->first;
-        
-        // Check if process is still running
-        if (kill(pid, 0) != 0) {
-            // Process is no longer running
-            it = running_processes.erase(it);
-        } else {
-            ++it;
+void NodeAgent::reap_exited_children() {
+    // Collect every exited child without blocking, then update the table
+    // with the real exit status in one lock acquisition
+    while (true) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid <= 0) {
+            break;
+        }
+
+        TableShard& shard = shard_for(pid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(pid);
+        if (it == shard.entries.end()) {
+            // Exited before its launch inserted the entry; park the status
+            // for the launch path to claim
+            std::lock_guard<std::mutex> parked_lock(unmatched_exits_mutex);
+            unmatched_exits[pid] = status;
+            continue;
+        }
+
+        if (WIFEXITED(status)) {
+            it->second.exit_code = WEXITSTATUS(status);
+            it->second.status = "EXITED (" + std::to_string(it->second.exit_code) + ")";
+        } else if (WIFSIGNALED(status)) {
+            it->second.exit_code = 128 + WTERMSIG(status);
+            it->second.status = "KILLED (signal " + std::to_string(WTERMSIG(status)) + ")";
+        }
+        it->second.exit_timestamp = time(nullptr);
+        it->second.last_change_seq = ++change_sequence;
+        persistent_table->record_update(it->second);
+
+        if (it->second.kill_deadline_ms != 0) {
+            // Exited before the escalation fired
+            it->second.kill_deadline_ms = 0;
+            pending_kills.fetch_sub(1);
         }
     }
-} 
\ No newline at end of file
+}
+
+void NodeAgent::purge_exited_entries() {
+    // Finished entries stay visible to /status for a retention window so
+    // the scheduler can observe the exit, then get dropped
+    time_t cutoff = time(nullptr) - EXITED_ENTRY_RETENTION_SECONDS;
+
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.begin();
+        while (it != shard.entries.end()) {
+            if (it->second.exit_timestamp != 0 && it->second.exit_timestamp < cutoff) {
+                {
+                    // Sequence assignment and the log append share the
+                    // removal log's critical section (see change_sequence)
+                    std::lock_guard<std::mutex> removal_lock(removal_mutex);
+                    removal_log.emplace_back(++change_sequence, it->first);
+                    while (removal_log.size() > REMOVAL_LOG_CAPACITY) {
+                        removal_log_trimmed_seq = removal_log.front().first;
+                        removal_log.pop_front();
+                    }
+                }
+                persistent_table->record_removal(it->first);
+                remove_log_capture(it->first);
+                remove_workload_cgroup(it->second.cgroup_path);
+                it = shard.entries.erase(it);
+                process_count.fetch_sub(1);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+uint64_t NodeAgent::get_processes_since(uint64_t since, std::vector<ProcessInfo>& changed,
+                                        std::vector<pid_t>& removed, bool& full_snapshot) {
+    // A cursor older than the retained removal history can't be caught up
+    // incrementally — fall back to the full table
+    {
+        std::lock_guard<std::mutex> removal_lock(removal_mutex);
+        full_snapshot = (since == 0 || since < removal_log_trimmed_seq);
+    }
+
+    // Sample the cursor before scanning: every change numbered at or below
+    // it was assigned inside a critical section we are about to enter, so
+    // the scan can't miss it; later changes are simply > cursor.
+    uint64_t cursor = change_sequence.load();
+
+    for (auto& shard : table_shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& pair : shard.entries) {
+            if (full_snapshot || pair.second.last_change_seq > since) {
+                changed.push_back(pair.second);
+            }
+        }
+    }
+
+    if (!full_snapshot) {
+        std::lock_guard<std::mutex> removal_lock(removal_mutex);
+        for (const auto& entry : removal_log) {
+            if (entry.first > since) {
+                removed.push_back(entry.second);
+            }
+        }
+    }
+
+    return cursor;
+}
\ No newline at end of file
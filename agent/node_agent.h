@@ -4,10 +4,14 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -19,6 +23,25 @@
 #include <cstring>
 #include <memory>
 
+class PersistentProcessTable;
+
+// UDP heartbeat datagram pushed to configured scheduler endpoints. One
+// packet per interval replaces a full TCP+HTTP status exchange; the
+// change_seq lets the scheduler decide whether a delta poll is needed.
+#pragma pack(push, 1)
+struct HeartbeatPacket
+{
+    char node_id[32];   // hostname, NUL-terminated/truncated
+    uint16_t agent_port;
+    double cpu_usage;
+    double memory_usage;
+    int64_t total_memory;
+    int64_t available_memory;
+    uint32_t running_processes;
+    uint64_t change_seq;
+};
+#pragma pack(pop)
+
 // System metrics structure
 struct SystemMetrics
 {
@@ -29,6 +52,38 @@ struct SystemMetrics
     int running_processes;
 };
 
+// One entry of a batch launch request. cpu_max/memory_max are optional
+// cgroup v2 limit values written verbatim to the workload's cpu.max and
+// memory.max (e.g. "50000 100000", "268435456"); empty means unlimited.
+struct LaunchRequest
+{
+    std::string script_path;
+    std::vector<std::string> args;
+    std::string cpu_max;
+    std::string memory_max;
+};
+
+// Outcome of one launch attempt
+struct LaunchResult
+{
+    pid_t pid;
+    bool success;
+};
+
+// Captured output of one workload. The launch path wires the child's
+// stdout/stderr to a pipe; the background worker drains it into a fixed
+// ring buffer (recent output, bounded memory) and a capped spill file
+// (full history, served zero-copy by GET /logs/<pid>).
+struct WorkloadLog
+{
+    int pipe_fd;            // read end of the capture pipe; -1 after EOF
+    int file_fd;            // spill file; -1 if creation failed
+    std::string file_path;
+    std::vector<char> ring;
+    size_t total_written;   // lifetime bytes through the ring
+    size_t file_bytes;      // bytes spilled so far (capped)
+};
+
 // Process information structure
 struct ProcessInfo
 {
@@ -36,6 +91,22 @@ struct ProcessInfo
     std::string command;
     std::string start_time;
     std::string status;
+    int exit_code;            // valid once status is EXITED/KILLED
+    time_t exit_timestamp;    // 0 while running; used to age out finished entries
+    int64_t kill_deadline_ms; // 0 = no pending kill; else steady-clock ms at
+                              // which the worker escalates SIGTERM to SIGKILL
+
+    // Per-process utilization, refreshed by the sampler sweep
+    double cpu_percent;
+    long rss_kb;
+    long prev_cpu_ticks;      // utime+stime ticks (or cgroup usage_usec) at
+                              // the previous sweep
+
+    // cgroup v2 leaf holding the workload's whole subtree; empty when
+    // placement is disabled or failed (plain /proc accounting applies)
+    std::string cgroup_path;
+
+    uint64_t last_change_seq; // table change sequence of the last mutation
 };
 
 class NodeAgent
@@ -44,16 +115,151 @@ private:
     int server_socket;
     int port;
     std::atomic<bool> running;
-    std::map<pid_t, ProcessInfo> running_processes;
-    std::mutex processes_mutex;
 
-    // CPU metrics tracking
+    // Sharded process table. Entries are spread across TABLE_SHARDS
+    // buckets by pid, each behind its own lock, so status reads, launches
+    // and the sampler sweep only contend when they hit the same shard.
+    // Sweeps lock one shard at a time; nothing ever holds two shard locks.
+    static constexpr size_t TABLE_SHARDS = 16;
+    struct TableShard
+    {
+        std::mutex mutex;
+        std::map<pid_t, ProcessInfo> entries;
+    };
+    TableShard table_shards[TABLE_SHARDS];
+    TableShard& shard_for(pid_t pid) {
+        return table_shards[(size_t)pid % TABLE_SHARDS];
+    }
+    std::atomic<size_t> process_count; // table entry count, for O(1) reads
+
+    // Monotonic change sequence for the process table. Sequence numbers
+    // are assigned inside the owning shard's (or, for removals, the
+    // removal log's) critical section: a delta reader that samples the
+    // sequence and then locks a shard is guaranteed to see every change
+    // numbered at or below its sample. Removals are remembered in a
+    // bounded log so delta readers can learn about purged entries; clients
+    // whose cursor predates the log get a full snapshot instead.
+    std::atomic<uint64_t> change_sequence;
+    std::deque<std::pair<uint64_t, pid_t>> removal_log;
+    uint64_t removal_log_trimmed_seq;
+    std::mutex removal_mutex;
+    static constexpr size_t REMOVAL_LOG_CAPACITY = 1024;
+
+    // A child can exit and be reaped before its launch has inserted the
+    // table entry (insertion no longer holds a lock across fork). The
+    // reaper parks such statuses here; the launch path claims them.
+    std::map<pid_t, int> unmatched_exits;
+    std::mutex unmatched_exits_mutex;
+
+    // CPU metrics tracking (only touched by the sampler thread)
     long prev_total_time;
     long prev_idle_time;
 
-    // Thread pool for handling multiple clients
+    // Double-buffered metrics snapshot. The sampler writes the inactive
+    // buffer and flips active_snapshot, so readers never block and never
+    // see a half-written snapshot.
+    SystemMetrics metrics_snapshots[2];
+    std::atomic<int> active_snapshot;
+
+    // Background worker (metrics sampling, child reaping)
+    std::thread background_thread;
+    std::atomic<bool> background_running;
+    static constexpr int METRICS_SAMPLE_INTERVAL_MS = 1000;
+    static constexpr int EXITED_ENTRY_RETENTION_SECONDS = 60;
+    static constexpr int KILL_ESCALATION_TIMEOUT_MS = 500;
+
+    // Number of entries with a pending SIGKILL deadline; lets the worker
+    // poll on a tight interval only while a stop is in flight
+    std::atomic<int> pending_kills;
+
+    // Self-pipe written by the SIGCHLD handler and polled by the worker
+    // thread, so child exits are observed within microseconds instead of
+    // waiting on a periodic sweep
+    static int sigchld_pipe[2];
+    static void sigchld_handler(int signum);
+
+    // Bounded worker pool for raw-TCP clients. The accept loop pushes
+    // sockets into the queue; when it is full the connection is refused
+    // immediately (backpressure) instead of spawning threads.
     std::vector<std::thread> worker_threads;
+    std::deque<int> client_queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
     static const int MAX_THREADS = 10;
+    static constexpr size_t MAX_QUEUED_CLIENTS = 128;
+
+    void sample_system_metrics();
+    void sample_process_metrics();
+    void sample_one_process_locked(ProcessInfo& info, double elapsed_seconds);
+    void mark_exit_unknown_locked(ProcessInfo& info);
+    int64_t last_process_sample_ms;
+
+    // Launch engine. posix_spawn (vfork-based in glibc) keeps launch cost
+    // flat as the agent's own RSS grows; set NODE_AGENT_LAUNCH_ENGINE=fork
+    // to fall back to classic fork+exec.
+    bool use_posix_spawn;
+
+    // Push mode: heartbeat datagrams to NODE_AGENT_PUSH_TARGETS
+    // ("host:port[,host:port...]"), sent on the sampler cadence
+    int heartbeat_socket;
+    std::vector<struct sockaddr_in> push_targets;
+    void setup_push_targets();
+    void send_heartbeats();
+
+    // Memory-mapped mirror of the process table (see process_table.h).
+    // Mutated at every table change point (it locks internally), recovered
+    // on startup so an agent restart doesn't orphan workload tracking.
+    // Path comes from NODE_AGENT_TABLE_FILE, default /tmp/node_agent_<port>.table
+    std::unique_ptr<PersistentProcessTable> persistent_table;
+    void recover_process_table();
+
+    // Per-workload output capture (see WorkloadLog). Entries live exactly
+    // as long as the matching process table entry.
+    std::map<pid_t, WorkloadLog> workload_logs;
+    std::mutex logs_mutex;
+    std::string log_directory;
+    void register_log_capture(pid_t pid, int pipe_fd);
+    void drain_workload_logs();
+    void remove_log_capture(pid_t pid);
+
+    // cgroup v2 placement (see setup_cgroup_root). When cgroup_root is
+    // non-empty each launch lands in its own leaf under it, limits from
+    // the request are applied, and the sampler reads cpu.stat and
+    // memory.current instead of walking /proc — one small file each,
+    // accurate across the workload's whole subtree of children.
+    std::string cgroup_root;
+    void setup_cgroup_root();
+    std::string create_workload_cgroup(pid_t pid, const LaunchRequest &request);
+    void remove_workload_cgroup(const std::string &cgroup_path);
+    static bool write_cgroup_file(const std::string &path, const char *value);
+    bool read_cgroup_metrics(ProcessInfo &info, double elapsed_seconds);
+
+    pid_t launch_process(const LaunchRequest &request);
+
+    // Admission-controlled launch queue. /start and /start_batch enqueue
+    // a descriptor and return immediately; the dispatcher thread drains
+    // the queue at NODE_AGENT_LAUNCH_RATE launches/sec (token bucket) and
+    // holds off while the tracked-process count is at
+    // NODE_AGENT_MAX_PROCESSES or the cached CPU sample is above
+    // ADMISSION_CPU_PERCENT. A burst of launches therefore ramps up at a
+    // bounded rate instead of forking all at once, and a full queue is
+    // rejected up front so the scheduler sees backpressure, not timeouts.
+    struct QueuedLaunch {
+        uint64_t queued_id;
+        LaunchRequest request;
+    };
+    std::deque<QueuedLaunch> launch_queue;
+    mutable std::mutex launch_queue_mutex;
+    std::condition_variable launch_queue_cv;
+    std::atomic<uint64_t> next_queued_id;
+    std::thread dispatcher_thread;
+    std::atomic<bool> draining;
+    int launch_rate_per_sec;
+    size_t max_tracked_processes;
+    static constexpr size_t MAX_QUEUED_LAUNCHES = 2048;
+    static constexpr double ADMISSION_CPU_PERCENT = 95.0;
+    static constexpr int DISPATCH_TICK_MS = 20;
+    void launch_dispatcher_function();
 
 public:
     NodeAgent(int port = 8080);
@@ -66,27 +272,74 @@ public:
 
     // Process management
     pid_t start_process(const std::string &script_path);
+    std::vector<LaunchResult> start_process_batch(const std::vector<LaunchRequest> &batch);
+
+    // Admission-controlled enqueue for the HTTP launch endpoints. Returns
+    // one queued id per request, or an empty vector when the queue cannot
+    // take the whole batch (the caller maps that to 503).
+    std::vector<uint64_t> enqueue_launches(const std::vector<LaunchRequest> &batch);
+    size_t get_launch_queue_depth() const;
+
+    // Drain mode (POST /drain, see handoff.h): new launches are refused
+    // while already-admitted queue entries still dispatch, so everything
+    // the agent promised to run lands in the table before handoff.
+    void begin_drain() { draining = true; }
+    bool is_draining() const { return draining; }
     bool stop_process(pid_t pid);
     std::vector<ProcessInfo> get_running_processes();
 
-    // Metrics collection
+    // Copy-free read: invokes fn for every entry while holding that
+    // entry's shard lock, so serializers write straight from the table.
+    // fn must not call back into the table.
+    void for_each_process(const std::function<void(const ProcessInfo &)> &fn);
+    size_t get_process_count() const { return process_count.load(); }
+
+    // Shard-wise variant for streaming serializers: one call covers one
+    // shard under its own lock, so a response built across many calls
+    // never pins the whole table at once.
+    static constexpr size_t TABLE_SHARD_COUNT = TABLE_SHARDS;
+    void for_each_process_in_shard(size_t shard,
+                                   const std::function<void(const ProcessInfo &)> &fn);
+
+    // Delta read: entries changed after `since` plus pids removed after it.
+    // Sets full_snapshot (and returns every entry) when `since` predates
+    // the retained removal history. Returns the current change sequence.
+    uint64_t get_processes_since(uint64_t since, std::vector<ProcessInfo>& changed,
+                                 std::vector<pid_t>& removed, bool& full_snapshot);
+
+    // Log access for the /logs endpoint. get_log_tail copies the last
+    // max_bytes of recent output out of the ring; open_log_file hands back
+    // a dup'd spill-file descriptor (caller closes) plus its size so the
+    // HTTP layer can sendfile it.
+    static constexpr size_t LOG_RING_CAPACITY = 64 * 1024;
+    static constexpr size_t MAX_LOG_FILE_BYTES = 4 * 1024 * 1024;
+    bool get_log_tail(pid_t pid, size_t max_bytes, std::string& out);
+    int open_log_file(pid_t pid, size_t& size);
+
+    // Metrics collection. get_system_metrics() is a snapshot read with no
+    // filesystem I/O; calculate_cpu_usage() is called by the sampler only.
     SystemMetrics get_system_metrics();
     double calculate_cpu_usage();
-    double calculate_memory_usage();
 
-    // Command handling
-    std::string handle_command(const std::string &command);
-    std::string handle_start_command(const std::vector<std::string> &args);
-    std::string handle_stop_command(const std::vector<std::string> &args);
-    std::string handle_status_command();
+    // Command handling. Commands are tokenized as string_views over the
+    // receive buffer and responses are appended to a reusable per-connection
+    // buffer, so STATUS and STOP run without touching the heap.
+    void handle_command(std::string_view command, std::string &response);
+    void handle_start_command(std::string_view script_path, std::string &response);
+    void handle_stop_command(std::string_view pid_text, std::string &response);
+    void handle_status_command(std::string &response);
 
     // Utility functions
     std::vector<std::string> split_string(const std::string &str, char delimiter);
     std::string get_current_time();
-    void cleanup_zombie_processes();
+    void reap_exited_children();
+    void purge_exited_entries();
+    void escalate_pending_kills();
+    static int64_t steady_now_ms();
 
     // Client connection handling
     void handle_client(int client_socket);
+    void client_worker_function();
     void worker_thread_function();
 };
 
@@ -0,0 +1,173 @@
+#include "process_table.h"
+#include "async_log.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+PersistentProcessTable::PersistentProcessTable()
+    : header(nullptr), records(nullptr), mapping(nullptr),
+      mapping_size(0), table_fd(-1) {}
+
+PersistentProcessTable::~PersistentProcessTable() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+    if (table_fd >= 0) {
+        close(table_fd);
+    }
+}
+
+bool PersistentProcessTable::open(const std::string& path) {
+    table_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (table_fd < 0) {
+        log_error("Error opening process table file: %s", path.c_str());
+        return false;
+    }
+
+    mapping_size = sizeof(ProcessTableHeader)
+                   + TABLE_CAPACITY * sizeof(PersistedProcessRecord);
+
+    struct stat st;
+    bool fresh = (fstat(table_fd, &st) != 0 || st.st_size != (off_t)mapping_size);
+    if (fresh && ftruncate(table_fd, mapping_size) != 0) {
+        log_error("Error sizing process table file: %s", path.c_str());
+        close(table_fd);
+        table_fd = -1;
+        return false;
+    }
+
+    mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, table_fd, 0);
+    if (mapping == MAP_FAILED) {
+        log_error("Error mapping process table file: %s", path.c_str());
+        mapping = nullptr;
+        close(table_fd);
+        table_fd = -1;
+        return false;
+    }
+
+    header = (ProcessTableHeader*)mapping;
+    records = (PersistedProcessRecord*)((char*)mapping + sizeof(ProcessTableHeader));
+
+    if (fresh || header->magic != TABLE_MAGIC || header->version != TABLE_VERSION
+        || header->capacity != TABLE_CAPACITY
+        || header->record_size != sizeof(PersistedProcessRecord)) {
+        // New file, or a layout we can't trust — start clean
+        if (!fresh) {
+            log_warn("Process table file has unexpected layout, reinitializing");
+        }
+        memset(mapping, 0, mapping_size);
+        header->magic = TABLE_MAGIC;
+        header->version = TABLE_VERSION;
+        header->capacity = TABLE_CAPACITY;
+        header->record_size = sizeof(PersistedProcessRecord);
+        header->generation = 0;
+    }
+
+    return true;
+}
+
+std::vector<ProcessInfo> PersistentProcessTable::recover() {
+    std::vector<ProcessInfo> survivors;
+    if (mapping == nullptr) {
+        return survivors;
+    }
+
+    for (uint32_t i = 0; i < header->capacity; i++) {
+        PersistedProcessRecord& record = records[i];
+        if (record.pid == 0) {
+            continue;
+        }
+
+        // A slot survives only if its PID is still alive. Exits that
+        // happened while no agent was running are unobservable, so dead
+        // slots are simply reclaimed.
+        if (record.exit_timestamp == 0 && kill(record.pid, 0) == 0) {
+            ProcessInfo info;
+            info.pid = record.pid;
+            info.command = record.command;
+            info.start_time = record.start_time;
+            info.status = record.status;
+            info.exit_code = record.exit_code;
+            info.exit_timestamp = record.exit_timestamp;
+            info.kill_deadline_ms = 0;
+            info.cpu_percent = 0.0;
+            info.rss_kb = 0;
+            info.prev_cpu_ticks = 0;
+            info.last_change_seq = 0;
+            survivors.push_back(info);
+            slot_index[record.pid] = i;
+        } else {
+            memset(&record, 0, sizeof(record));
+        }
+    }
+
+    if (!survivors.empty()) {
+        header->generation++;
+    }
+    return survivors;
+}
+
+void PersistentProcessTable::write_record(PersistedProcessRecord& record,
+                                          const ProcessInfo& info) {
+    record.pid = info.pid;
+    strncpy(record.command, info.command.c_str(), sizeof(record.command) - 1);
+    record.command[sizeof(record.command) - 1] = '\0';
+    strncpy(record.start_time, info.start_time.c_str(), sizeof(record.start_time) - 1);
+    record.start_time[sizeof(record.start_time) - 1] = '\0';
+    strncpy(record.status, info.status.c_str(), sizeof(record.status) - 1);
+    record.status[sizeof(record.status) - 1] = '\0';
+    record.exit_code = info.exit_code;
+    record.exit_timestamp = info.exit_timestamp;
+}
+
+void PersistentProcessTable::record_launch(const ProcessInfo& info) {
+    if (mapping == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(table_mutex);
+
+    for (uint32_t i = 0; i < header->capacity; i++) {
+        if (records[i].pid == 0) {
+            write_record(records[i], info);
+            slot_index[info.pid] = i;
+            header->generation++;
+            return;
+        }
+    }
+    // Table full: the entry stays in-memory only and is lost on restart
+    log_warn("Process table file is full, not persisting pid %d", info.pid);
+}
+
+void PersistentProcessTable::record_update(const ProcessInfo& info) {
+    if (mapping == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(table_mutex);
+
+    auto it = slot_index.find(info.pid);
+    if (it == slot_index.end()) {
+        return;
+    }
+    write_record(records[it->second], info);
+    header->generation++;
+}
+
+void PersistentProcessTable::record_removal(pid_t pid) {
+    if (mapping == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(table_mutex);
+
+    auto it = slot_index.find(pid);
+    if (it == slot_index.end()) {
+        return;
+    }
+    memset(&records[it->second], 0, sizeof(PersistedProcessRecord));
+    slot_index.erase(it);
+    header->generation++;
+}
@@ -0,0 +1,82 @@
+#ifndef PROCESS_TABLE_H
+#define PROCESS_TABLE_H
+
+#include "node_agent.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+// Fixed-size on-disk slot for one tracked process. Plain POD so a table
+// mutation is a struct write into the mapping — no serialization pass.
+#pragma pack(push, 1)
+struct PersistedProcessRecord
+{
+    int32_t pid;              // 0 = free slot
+    char command[128];        // NUL-terminated, truncated if longer
+    char start_time[32];
+    char status[48];
+    int32_t exit_code;
+    int64_t exit_timestamp;
+};
+
+struct ProcessTableHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t record_size;     // sanity check against layout drift
+    uint64_t generation;      // bumped on every mutation
+};
+#pragma pack(pop)
+
+// Memory-mapped process table backing NodeAgent's in-memory map. The agent
+// updates a slot in place on every launch, status change and removal, so
+// after a crash or upgrade the successor remaps the file and recovers its
+// PID tracking in microseconds instead of treating every workload as lost.
+//
+// The mutation mirrors serialize on an internal mutex (the agent's table
+// is sharded, so there is no single caller-side lock to lean on); open()
+// and recover() run before any mutator thread exists. Every method is a
+// no-op when the file could not be mapped, so the agent degrades to
+// in-memory-only.
+class PersistentProcessTable
+{
+private:
+    static constexpr uint32_t TABLE_MAGIC = 0x4E415054;  // "NAPT"
+    static constexpr uint32_t TABLE_VERSION = 1;
+    static constexpr uint32_t TABLE_CAPACITY = 1024;
+
+    ProcessTableHeader* header;
+    PersistedProcessRecord* records;
+    void* mapping;
+    size_t mapping_size;
+    int table_fd;
+
+    // pid -> slot index, rebuilt on open so mutations don't scan the file
+    std::map<pid_t, uint32_t> slot_index;
+    std::mutex table_mutex;
+
+    void write_record(PersistedProcessRecord& record, const ProcessInfo& info);
+
+public:
+    PersistentProcessTable();
+    ~PersistentProcessTable();
+
+    // Maps the file at `path`, creating or re-initializing it if it is
+    // missing or malformed. Returns false (and logs) on failure.
+    bool open(const std::string& path);
+
+    // Returns surviving entries: slots whose PID is still alive. Dead
+    // slots are freed in place; live ones keep their slot for updates.
+    std::vector<ProcessInfo> recover();
+
+    // Mutation mirrors, called at the agent's table mutation points
+    void record_launch(const ProcessInfo& info);
+    void record_update(const ProcessInfo& info);
+    void record_removal(pid_t pid);
+
+    bool is_mapped() const { return mapping != nullptr; }
+};
+
+#endif // PROCESS_TABLE_H
@@ -1,111 +1,427 @@
+// Load-generation and latency benchmark harness for the Node Agent.
+//
+// Opens a configurable number of concurrent keep-alive HTTP connections,
+// drives a configurable request mix against /status, /start and /stop for a
+// fixed duration, and reports requests/sec plus p50/p95/p99/p999 latency
+// measured from client-side timestamps.
+//
+//   ./test_client --port 8080 --connections 16 --duration 10
+//                 --mix status:90,start:5,stop:5 --script sleep --arg 1
+//
+// Or via the Makefile: make bench BENCH_PORT=8080 BENCH_CONNECTIONS=16
+
 #include <iostream>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <random>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
+#include <cstdlib>
+
+struct BenchConfig {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 8;
+    int duration_seconds = 10;
+    int mix_status = 100;   // request mix weights
+    int mix_start = 0;
+    int mix_stop = 0;
+    std::string script = "sleep";
+    std::string script_arg = "1";
+};
+
+struct WorkerStats {
+    std::vector<uint64_t> latencies_us;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t reconnects = 0;
+};
+
+static std::atomic<bool> bench_running{true};
 
-class TestClient {
+// Blocking keep-alive HTTP/1.1 connection that measures one request at a time
+class BenchConnection {
 private:
     int sock;
     std::string host;
     int port;
+    std::string read_buffer;
 
 public:
-    TestClient(const std::string& host = "localhost", int port = 8080) 
-        : host(host), port(port), sock(-1) {}
-    
-    ~TestClient() {
-        if (sock >= 0) {
-            close(sock);
-        }
+    BenchConnection(const std::string& host, int port)
+        : sock(-1), host(host), port(port) {}
+
+    ~BenchConnection() {
+        disconnect();
     }
-    
+
     bool connect() {
+        disconnect();
+
         sock = socket(AF_INET, SOCK_STREAM, 0);
         if (sock < 0) {
-            std::cerr << "Error creating socket" << std::endl;
             return false;
         }
-        
+
+        int opt = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
         struct sockaddr_in server_addr;
+        memset(&server_addr, 0, sizeof(server_addr));
         server_addr.sin_family = AF_INET;
         server_addr.sin_port = htons(port);
-        
         if (inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr) <= 0) {
-            std::cerr << "Invalid address" << std::endl;
+            disconnect();
             return false;
         }
-        
+
         if (::connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-            std::cerr << "Connection failed" << std::endl;
+            disconnect();
             return false;
         }
-        
+
+        read_buffer.clear();
         return true;
     }
-    
-    std::string send_command(const std::string& command) {
-        if (sock < 0) {
-            return "ERROR: Not connected";
-        }
-        
-        if (send(sock, command.c_str(), command.length(), 0) < 0) {
-            return "ERROR: Failed to send command";
-        }
-        
-        char buffer[4096];
-        memset(buffer, 0, sizeof(buffer));
-        int bytes_received = recv(sock, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_received <= 0) {
-            return "ERROR: No response received";
-        }
-        
-        return std::string(buffer);
+
+    void disconnect() {
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+
+    bool is_connected() const { return sock >= 0; }
+
+    // Sends one request and reads the complete response (headers plus
+    // Content-Length body). Returns false on any socket or framing error.
+    bool exchange(const std::string& request, std::string& out) {
+        size_t sent = 0;
+        while (sent < request.length()) {
+            ssize_t n = send(sock, request.data() + sent, request.length() - sent,
+                             MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            sent += n;
+        }
+
+        char buffer[8192];
+        size_t header_end = std::string::npos;
+        size_t body_needed = 0;
+
+        while (true) {
+            if (header_end == std::string::npos) {
+                header_end = read_buffer.find("\r\n\r\n");
+                if (header_end != std::string::npos) {
+                    size_t cl = read_buffer.find("Content-Length:");
+                    if (cl == std::string::npos || cl > header_end) {
+                        return false;
+                    }
+                    body_needed = header_end + 4 + strtoul(read_buffer.c_str() + cl + 15,
+                                                           nullptr, 10);
+                }
+            }
+            if (header_end != std::string::npos && read_buffer.length() >= body_needed) {
+                break;
+            }
+
+            ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                return false;
+            }
+            read_buffer.append(buffer, n);
+        }
+
+        out.assign(read_buffer, 0, body_needed);
+        read_buffer.erase(0, body_needed);
+        return true;
     }
 };
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: " << argv[0] << " <command> [args...]" << std::endl;
-        std::cout << "Commands:" << std::endl;
-        std::cout << "  status                    - Get system status" << std::endl;
-        std::cout << "  start <script_path>       - Start a workload" << std::endl;
-        std::cout << "  stop <pid>                - Stop a process" << std::endl;
-        return 1;
+static std::string build_request(const BenchConfig& config, const std::string& method,
+                                 const std::string& path, const std::string& body) {
+    std::string request = method + " " + path + " HTTP/1.1\r\n";
+    request += "Host: " + config.host + "\r\n";
+    if (!body.empty()) {
+        request += "Content-Length: " + std::to_string(body.length()) + "\r\n";
     }
-    
-    TestClient client;
-    
-    if (!client.connect()) {
-        std::cerr << "Failed to connect to Node Agent" << std::endl;
-        return 1;
+    request += "\r\n";
+    request += body;
+    return request;
+}
+
+// Pulls the pid out of a /start response ({"pid":1234,...}); 0 if absent.
+// Since the admission queue landed, /start answers {"queued_id":N} with no
+// pid, so this only matches agents predating it.
+static pid_t parse_started_pid(const std::string& response) {
+    size_t pos = response.find("\"pid\":");
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    return (pid_t)strtol(response.c_str() + pos + 6, nullptr, 10);
+}
+
+// Collects pids of RUNNING workloads matching our script from a /status
+// body. Queued launches carry no pid in the /start response, so the
+// harness resolves its stop targets this way; workers may race to stop
+// the same pid, in which case the loser's /stop reports a failure body
+// (still a completed request), mirroring a scheduler retry race.
+static void harvest_running_pids(const std::string& response, const std::string& script,
+                                 std::vector<pid_t>& out) {
+    const std::string wanted_command = "\"command\":\"" + script + "\"";
+    size_t pos = 0;
+    while ((pos = response.find("{\"pid\":", pos)) != std::string::npos) {
+        size_t end = response.find('}', pos);
+        if (end == std::string::npos) {
+            break;
+        }
+        std::string entry = response.substr(pos, end - pos);
+        pid_t pid = (pid_t)strtol(entry.c_str() + 7, nullptr, 10);
+        if (pid > 0 && entry.find("\"status\":\"RUNNING\"") != std::string::npos &&
+            entry.find(wanted_command) != std::string::npos) {
+            out.push_back(pid);
+        }
+        pos = end;
     }
-    
-    std::string command;
-    if (std::string(argv[1]) == "status") {
-        command = "STATUS";
-    } else if (std::string(argv[1]) == "start") {
-        if (argc < 3) {
-            std::cerr << "START command requires script path" << std::endl;
+}
+
+static void worker(const BenchConfig& config, unsigned seed, WorkerStats& stats) {
+    BenchConnection conn(config.host, config.port);
+    std::minstd_rand rng(seed);
+
+    const std::string status_request = build_request(config, "GET", "/status", "");
+    const std::string start_request = build_request(
+        config, "POST", "/start",
+        "{\"script_path\":\"" + config.script + "\",\"args\":[\"" +
+            config.script_arg + "\"]}");
+
+    // Stop targets for the /stop mix: pids resolved from /status after
+    // this worker's queued launches, or taken straight from the /start
+    // response on agents that still answer with a pid
+    std::vector<pid_t> started_pids;
+    uint64_t queued_starts = 0;
+    std::string response;
+
+    int mix_total = config.mix_status + config.mix_start + config.mix_stop;
+
+    while (bench_running.load(std::memory_order_relaxed)) {
+        if (!conn.is_connected()) {
+            if (!conn.connect()) {
+                stats.reconnects++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+        }
+
+        // Pick this iteration's request type from the configured mix
+        int roll = (int)(rng() % mix_total);
+        const std::string* request = &status_request;
+        bool is_start = false;
+        bool is_harvest = false;
+        std::string stop_request;
+        if (roll >= config.mix_status) {
+            if (roll < config.mix_status + config.mix_start) {
+                request = &start_request;
+                is_start = true;
+            } else if (!started_pids.empty()) {
+                pid_t pid = started_pids.back();
+                started_pids.pop_back();
+                stop_request = build_request(config, "POST", "/stop",
+                                             "{\"pid\":" + std::to_string(pid) + "}");
+                request = &stop_request;
+            } else if (queued_starts > 0) {
+                // Stop rolled but the queued launches have no known pids
+                // yet; spend the iteration on a /status poll and harvest
+                // stop targets from it
+                request = &status_request;
+                is_harvest = true;
+            } else {
+                request = &start_request;
+                is_start = true;
+            }
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        bool ok = conn.exchange(*request, response);
+        auto end = std::chrono::steady_clock::now();
+
+        if (!ok) {
+            stats.errors++;
+            conn.disconnect();
+            continue;
+        }
+
+        stats.requests++;
+        stats.latencies_us.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count());
+
+        if (is_start) {
+            pid_t pid = parse_started_pid(response);
+            if (pid > 0) {
+                started_pids.push_back(pid);
+            } else if (response.find("\"queued_id\":") != std::string::npos) {
+                queued_starts++;
+            }
+        } else if (is_harvest) {
+            harvest_running_pids(response, config.script, started_pids);
+            if (!started_pids.empty()) {
+                queued_starts = 0;
+            }
+        }
+    }
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static bool parse_mix(const std::string& spec, BenchConfig& config) {
+    // Format: status:90,start:5,stop:5 (weights, need not sum to 100)
+    config.mix_status = config.mix_start = config.mix_stop = 0;
+
+    size_t pos = 0;
+    while (pos < spec.length()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = spec.length();
+        }
+        std::string part = spec.substr(pos, comma - pos);
+        size_t colon = part.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        std::string name = part.substr(0, colon);
+        int weight = atoi(part.c_str() + colon + 1);
+        if (name == "status") {
+            config.mix_status = weight;
+        } else if (name == "start") {
+            config.mix_start = weight;
+        } else if (name == "stop") {
+            config.mix_stop = weight;
+        } else {
+            return false;
+        }
+        pos = comma + 1;
+    }
+
+    return config.mix_status + config.mix_start + config.mix_stop > 0;
+}
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --host <addr>        Agent address (default 127.0.0.1)" << std::endl;
+    std::cout << "  --port <port>        Agent HTTP port (default 8080)" << std::endl;
+    std::cout << "  --connections <n>    Concurrent connections (default 8)" << std::endl;
+    std::cout << "  --duration <sec>     Run length in seconds (default 10)" << std::endl;
+    std::cout << "  --mix <spec>         Request mix, e.g. status:90,start:5,stop:5" << std::endl;
+    std::cout << "                       (default status:100)" << std::endl;
+    std::cout << "  --script <path>      Workload for /start requests (default sleep)" << std::endl;
+    std::cout << "  --arg <value>        Argument for the workload (default 1)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--help" || flag == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << flag << std::endl;
             return 1;
         }
-        command = "START " + std::string(argv[2]);
-    } else if (std::string(argv[1]) == "stop") {
-        if (argc < 3) {
-            std::cerr << "STOP command requires PID" << std::endl;
+        std::string value = argv[++i];
+        if (flag == "--host") {
+            config.host = value;
+        } else if (flag == "--port") {
+            config.port = atoi(value.c_str());
+        } else if (flag == "--connections") {
+            config.connections = atoi(value.c_str());
+        } else if (flag == "--duration") {
+            config.duration_seconds = atoi(value.c_str());
+        } else if (flag == "--mix") {
+            if (!parse_mix(value, config)) {
+                std::cerr << "Bad mix spec: " << value << std::endl;
+                return 1;
+            }
+        } else if (flag == "--script") {
+            config.script = value;
+        } else if (flag == "--arg") {
+            config.script_arg = value;
+        } else {
+            std::cerr << "Unknown option: " << flag << std::endl;
+            print_usage(argv[0]);
             return 1;
         }
-        command = "STOP " + std::string(argv[2]);
-    } else {
-        std::cerr << "Unknown command: " << argv[1] << std::endl;
+    }
+
+    if (config.connections < 1 || config.duration_seconds < 1) {
+        std::cerr << "connections and duration must be positive" << std::endl;
         return 1;
     }
-    
-    std::string response = client.send_command(command);
-    std::cout << response << std::endl;
-    
-    return 0;
-} 
\ No newline at end of file
+
+    std::cout << "Benchmarking " << config.host << ":" << config.port << " with "
+              << config.connections << " connection(s) for "
+              << config.duration_seconds << "s (mix status:" << config.mix_status
+              << " start:" << config.mix_start << " stop:" << config.mix_stop
+              << ")" << std::endl;
+
+    std::vector<WorkerStats> stats(config.connections);
+    std::vector<std::thread> threads;
+    threads.reserve(config.connections);
+
+    auto bench_begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < config.connections; i++) {
+        threads.emplace_back(worker, std::cref(config), (unsigned)(i + 1),
+                             std::ref(stats[i]));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(config.duration_seconds));
+    bench_running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto bench_end = std::chrono::steady_clock::now();
+
+    double elapsed = std::chrono::duration<double>(bench_end - bench_begin).count();
+
+    std::vector<uint64_t> all_latencies;
+    uint64_t requests = 0, errors = 0, reconnects = 0;
+    for (const auto& s : stats) {
+        all_latencies.insert(all_latencies.end(), s.latencies_us.begin(),
+                             s.latencies_us.end());
+        requests += s.requests;
+        errors += s.errors;
+        reconnects += s.reconnects;
+    }
+    std::sort(all_latencies.begin(), all_latencies.end());
+
+    std::cout << std::endl;
+    std::cout << "Requests:    " << requests << " (" << errors << " errors, "
+              << reconnects << " reconnects)" << std::endl;
+    std::cout << "Throughput:  " << (uint64_t)(requests / elapsed) << " req/s"
+              << std::endl;
+    std::cout << "Latency:     p50="  << percentile(all_latencies, 0.50) << "us"
+              << "  p95="  << percentile(all_latencies, 0.95) << "us"
+              << "  p99="  << percentile(all_latencies, 0.99) << "us"
+              << "  p999=" << percentile(all_latencies, 0.999) << "us"
+              << std::endl;
+
+    return errors > requests ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+#!/bin/bash
+
+# Drain-and-handoff test for the Node Agent
+# Performs a zero-downtime handoff while a scheduler holds an idle binary
+# connection open, and proves the old process actually exits: the binary
+# workers used to sit in recv() on that connection and block shutdown.
+
+PORT=18850
+BINARY_PORT=$((PORT + 1))
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+# Function to print colored output
+print_status() {
+    local status=$1
+    local message=$2
+    if [ "$status" = "PASS" ]; then
+        echo -e "${GREEN}[PASS]${NC} $message"
+    elif [ "$status" = "FAIL" ]; then
+        echo -e "${RED}[FAIL]${NC} $message"
+    elif [ "$status" = "INFO" ]; then
+        echo -e "${BLUE}[INFO]${NC} $message"
+    else
+        echo -e "${YELLOW}[INFO]${NC} $message"
+    fi
+}
+
+cleanup() {
+    kill $OLD_PID $NEW_PID $CLIENT_PID 2>/dev/null
+    wait $OLD_PID $NEW_PID $CLIENT_PID 2>/dev/null
+    pkill -f "sleep 300" 2>/dev/null
+    rm -f /tmp/node_agent_${PORT}.table /tmp/node_agent_${PORT}.handoff
+    rm -rf /tmp/node_agent_${PORT}_logs
+}
+trap cleanup EXIT
+
+echo "=== Node Agent Drain/Handoff Test ==="
+echo
+
+if [ ! -f "../agent/agent" ]; then
+    print_status "FAIL" "Agent binary not found. Please build the agent first:"
+    echo "  cd ../agent && make"
+    exit 1
+fi
+
+rm -f /tmp/node_agent_${PORT}.table /tmp/node_agent_${PORT}.handoff
+rm -rf /tmp/node_agent_${PORT}_logs
+
+# Start the old agent
+print_status "INFO" "Starting old agent on port $PORT..."
+../agent/agent $PORT > /tmp/drain_test_old.log 2>&1 &
+OLD_PID=$!
+sleep 1
+
+if ! kill -0 $OLD_PID 2>/dev/null; then
+    print_status "FAIL" "Old agent failed to start"
+    exit 1
+fi
+print_status "PASS" "Old agent started (PID: $OLD_PID)"
+
+# Hold an idle binary connection open for the whole handoff, the way a
+# real scheduler does between polls: one status frame, then silence
+print_status "INFO" "Opening idle binary connection on port $BINARY_PORT..."
+python3 - $BINARY_PORT > /tmp/drain_test_client.log 2>&1 <<'EOF' &
+import socket, struct, sys, time
+def read_exact(s, n):
+    data = b""
+    while len(data) < n:
+        chunk = s.recv(n - len(data))
+        if not chunk:
+            raise EOFError("connection closed")
+        data += chunk
+    return data
+s = socket.create_connection(("127.0.0.1", int(sys.argv[1])), timeout=5)
+s.sendall(struct.pack("<IB", 0, 1))  # OP_STATUS_REQUEST
+length, opcode = struct.unpack("<IB", read_exact(s, 5))
+read_exact(s, length)
+print("status frame ok, going idle")
+time.sleep(60)
+EOF
+CLIENT_PID=$!
+sleep 1
+
+if ! grep -q "status frame ok" /tmp/drain_test_client.log; then
+    print_status "FAIL" "Binary connection did not get a status response"
+    exit 1
+fi
+print_status "PASS" "Idle binary connection established"
+
+# Start a workload the successor must pick up from the table
+START_RESPONSE=$(curl -s -X POST http://localhost:$PORT/start \
+    -d '{"script_path": "/bin/sleep", "args": ["300"]}')
+if ! echo "$START_RESPONSE" | grep -q "queued"; then
+    print_status "FAIL" "Workload submission failed: $START_RESPONSE"
+    exit 1
+fi
+print_status "PASS" "Workload submitted"
+sleep 1
+
+# Drain the old agent and bring up the successor
+print_status "INFO" "Draining old agent and starting successor..."
+DRAIN_RESPONSE=$(curl -s -X POST http://localhost:$PORT/drain)
+if ! echo "$DRAIN_RESPONSE" | grep -q "draining"; then
+    print_status "FAIL" "Drain request failed: $DRAIN_RESPONSE"
+    exit 1
+fi
+
+../agent/agent $PORT > /tmp/drain_test_new.log 2>&1 &
+NEW_PID=$!
+
+# The old process must exit on its own despite the idle binary
+# connection — this is the regression this test guards against
+EXITED=0
+for i in $(seq 1 15); do
+    if ! kill -0 $OLD_PID 2>/dev/null; then
+        EXITED=1
+        break
+    fi
+    sleep 1
+done
+
+if [ $EXITED -eq 1 ]; then
+    print_status "PASS" "Old agent exited after handoff (waited ${i}s)"
+else
+    print_status "FAIL" "Old agent still running 15s after handoff"
+    exit 1
+fi
+
+# The successor should be serving and have recovered the workload
+STATUS_RESPONSE=$(curl -s http://localhost:$PORT/status)
+if echo "$STATUS_RESPONSE" | grep -q '"command":"/bin/sleep"'; then
+    print_status "PASS" "Successor recovered the workload from the table"
+else
+    print_status "FAIL" "Successor did not recover the workload"
+    echo "Response: $STATUS_RESPONSE"
+    exit 1
+fi
+
+if grep -q "adopted" /tmp/drain_test_new.log; then
+    print_status "PASS" "Successor adopted the predecessor's listeners"
+else
+    print_status "FAIL" "Successor bound fresh listeners instead of adopting"
+    exit 1
+fi
+
+echo
+print_status "INFO" "Drain/handoff test completed!"